@@ -0,0 +1,643 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+// Microbenchmarks of the hot functions, each run in isolation over a given
+// count of objects placed in the first level. Every benchmark repeats rounds
+// of count operations for the given time, and reports ns per
+// operation (per object) and objects per second. The results can be written
+// as JSON and compared with a baseline written the same way.
+
+#include "objects.h"
+#include "broadphase.h"
+#include "framecontrol.h"
+#include "game.h"
+#include "helpers.h"
+#include "levels.h"
+#include "render.h"
+#include <SDL2/SDL_ttf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    BENCH_MAX_COUNTS = 16,
+    BENCH_MAX_RESULTS = 512,
+    BENCH_NAME_SIZE = 64,
+    BENCH_BATCHES = 5
+};
+
+typedef struct {
+    char name[BENCH_NAME_SIZE];
+    int count;
+    double nsPerOp;
+    double objectsPerSecond;
+    double nsPerRound;
+} BenchResult;
+
+// One round does count operations and returns the ns spent in them
+typedef uint64_t (*BenchRound)(int count);
+
+static struct {
+    double minTime;                 // Seconds per benchmark, all batches
+    int counts[BENCH_MAX_COUNTS];
+    int countCount;
+    const char* filter;             // Only the benchmarks whose names contain it
+    bool render;
+    BenchResult results[BENCH_MAX_RESULTS];
+    int resultCount;
+
+    Object** objects;               // Objects created for the current benchmark
+    Scalar* startX;                 // Their positions, restored before each move round
+    Scalar* startY;                 //
+    int* cells;                     // Random cells for the queries, see Level_GetCell()
+    int hitTest;                    // Flags of the move benchmark
+    int removedPercent;             // Of the clean benchmark
+    ObjectTypeId typeId;            // Of the created objects
+} bench;
+
+static volatile int sink;           // Results go here, so the calls are not optimized out
+
+static uint64_t Bench_Now()
+{
+    const uint64_t counter = SDL_GetPerformanceCounter();
+    const uint64_t frequency = SDL_GetPerformanceFrequency();
+    return (counter / frequency) * 1000000000ull + (counter % frequency) * 1000000000ull / frequency;
+}
+
+// A random cell the object can stand in
+static void Bench_RandomCell(int* r, int* c)
+{
+    do
+    {
+        *r = Util_Random() % level->rowCount;
+        *c = Util_Random() % level->columnCount;
+    }
+    while (Util_IsSolid(*r, *c, SOLID_ALL));
+}
+
+static void Bench_CreateObjects(ObjectTypeId typeId, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int r, c;
+        Bench_RandomCell(&r, &c);
+
+        Object* object = Types_CreateObject(level, typeId, r, c);
+        object->vx = Util_Random() % 2 ? SCALAR(96) : SCALAR(-96);
+        object->vy = Util_Random() % 2 ? SCALAR(96) : SCALAR(-96);
+
+        bench.objects[i] = object;
+        bench.startX[i] = object->x;
+        bench.startY[i] = object->y;
+        bench.cells[i] = Level_GetCell(level, r, c);
+    }
+
+    Broadphase_Build(level);
+}
+
+static void Bench_RemoveObjects(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        bench.objects[i]->removed = true;
+    }
+
+    ObjectArray_Clean(&level->objects, &level->pool);
+    Broadphase_Build(level);
+}
+
+static void Bench_AddResult(const char* name, int count, uint64_t rounds, uint64_t time)
+{
+    if (bench.resultCount == BENCH_MAX_RESULTS)
+    {
+        return;
+    }
+
+    BenchResult* result = &bench.results[bench.resultCount++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->count = count;
+    result->nsPerOp = (double)time / (rounds * count);
+    result->objectsPerSecond = rounds * count / (time / 1e9);
+    result->nsPerRound = (double)time / rounds;
+
+    printf("%-28s %6d %12.2f ns/op %14.0f objects/s\n",
+        result->name, result->count, result->nsPerOp, result->objectsPerSecond);
+}
+
+// The time is split into batches and the fastest batch is reported: the
+// interruptions only make batches slower, so the fastest one is the most
+// repeatable
+static void Bench_Run(const char* name, int count, BenchRound round)
+{
+    // Warm up the caches and the branch predictors
+    round(count);
+
+    uint64_t bestRounds = 0;
+    uint64_t bestTime = 0;
+    const uint64_t batchTime = bench.minTime * 1e9 / BENCH_BATCHES;
+
+    for (int batch = 0; batch < BENCH_BATCHES; batch++)
+    {
+        // The rounds may do untimed preparations, so the limit is the real time
+        uint64_t rounds = 0;
+        uint64_t time = 0;
+        const uint64_t start = Bench_Now();
+
+        while (Bench_Now() - start < batchTime || rounds < 3)
+        {
+            time += round(count);
+            rounds += 1;
+        }
+
+        if (bestRounds == 0 || (double)time / rounds < (double)bestTime / bestRounds)
+        {
+            bestRounds = rounds;
+            bestTime = time;
+        }
+    }
+
+    Bench_AddResult(name, count, bestRounds, bestTime > 0 ? bestTime : 1);
+}
+
+static bool Bench_Selected(const char* name)
+{
+    return !bench.filter || strstr(name, bench.filter);
+}
+
+
+// Benchmarks
+
+static uint64_t Bench_Move(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        bench.objects[i]->x = bench.startX[i];
+        bench.objects[i]->y = bench.startY[i];
+    }
+
+    const uint64_t start = Bench_Now();
+    int result = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        result += Object_Move(bench.objects[i], bench.hitTest);
+    }
+
+    sink = result;
+    return Bench_Now() - start;
+}
+
+static uint64_t Bench_HitTest(int count)
+{
+    const uint64_t start = Bench_Now();
+    int result = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        result += Util_HitTest((Object*)&player, bench.objects[i]);
+    }
+
+    sink = result;
+    return Bench_Now() - start;
+}
+
+static uint64_t Bench_IsVisible(int count)
+{
+    const uint64_t start = Bench_Now();
+    int result = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        result += Object_IsVisible(bench.objects[i], (Object*)&player);
+    }
+
+    sink = result;
+    return Bench_Now() - start;
+}
+
+static uint64_t Bench_FindNearItem(int count)
+{
+    const uint64_t start = Bench_Now();
+    int result = 0;
+
+    // The even queries are in the item cells, the odd ones are mostly empty
+    const int cellCount = level->rowCount * level->columnCount;
+    for (int i = 0; i < count; i++)
+    {
+        const int cell = (i % 2 == 0) ? bench.cells[i] : (bench.cells[i] + cellCount / 2) % cellCount;
+        result += Util_FindNearItem(cell / level->columnCount, cell % level->columnCount) != NULL;
+    }
+
+    sink = result;
+    return Bench_Now() - start;
+}
+
+static uint64_t Bench_Clean(int count)
+{
+    Bench_CreateObjects(bench.typeId, count);
+
+    for (int i = 0; i < count; i++)
+    {
+        bench.objects[i]->removed = (i % 100) < bench.removedPercent;
+    }
+
+    const uint64_t start = Bench_Now();
+    ObjectArray_Clean(&level->objects, &level->pool);
+    const uint64_t time = Bench_Now() - start;
+
+    // The survivors are removed outside of the measurement
+    for (int i = 0; i < count; i++)
+    {
+        if ((i % 100) >= bench.removedPercent)
+        {
+            bench.objects[i]->removed = true;
+        }
+    }
+    ObjectArray_Clean(&level->objects, &level->pool);
+
+    return time;
+}
+
+static uint64_t Bench_CreateObject(int count)
+{
+    const uint64_t start = Bench_Now();
+
+    for (int i = 0; i < count; i++)
+    {
+        Object* object = Types_CreateObject(level, bench.typeId, i % level->rowCount, i % level->columnCount);
+        object->removed = true;
+    }
+    ObjectArray_Clean(&level->objects, &level->pool);
+
+    return Bench_Now() - start;
+}
+
+// The whole screen with all the objects, so count is not used. Without the
+// render thread the frame is captured, drawn and presented in the call.
+static uint64_t Bench_DrawFrame(int count)
+{
+    (void)count;
+    const uint64_t start = Bench_Now();
+    Render_SubmitFrame(MESSAGE_NONE);
+    return Bench_Now() - start;
+}
+
+static const char* Bench_HitTestName(int hitTest)
+{
+    static char name[BENCH_NAME_SIZE];
+
+    snprintf(name, sizeof(name), "move/%s%s%s%s",
+        hitTest == HITTEST_NONE ? "none" : "",
+        hitTest & HITTEST_WALLS ? "walls" : "",
+        (hitTest & HITTEST_FLOOR) ? ((hitTest & HITTEST_WALLS) ? "+floor" : "floor") : "",
+        (hitTest & HITTEST_LEVEL) ? ((hitTest & (HITTEST_WALLS | HITTEST_FLOOR)) ? "+level" : "level") : "");
+
+    return name;
+}
+
+static void Bench_RunAll()
+{
+    static const int REMOVED_PERCENTS[] = {0, 10, 50, 90};
+    char name[BENCH_NAME_SIZE];
+
+    for (int k = 0; k < bench.countCount; k++)
+    {
+        const int count = bench.counts[k];
+
+        bench.objects = (Object**)malloc(count * sizeof(Object*));
+        bench.startX = (Scalar*)malloc(count * sizeof(Scalar));
+        bench.startY = (Scalar*)malloc(count * sizeof(Scalar));
+        bench.cells = (int*)malloc(count * sizeof(int));
+
+        Util_SeedRandom(1);
+        Bench_CreateObjects(TYPE_RAT, count);
+
+        for (int hitTest = 0; hitTest <= HITTEST_ALL; hitTest++)
+        {
+            bench.hitTest = hitTest;
+            if (Bench_Selected(Bench_HitTestName(hitTest)))
+            {
+                Bench_Run(Bench_HitTestName(hitTest), count, Bench_Move);
+            }
+        }
+
+        if (Bench_Selected("Util_HitTest"))
+        {
+            Bench_Run("Util_HitTest", count, Bench_HitTest);
+        }
+
+        if (Bench_Selected("isVisible"))
+        {
+            Bench_Run("isVisible", count, Bench_IsVisible);
+        }
+
+        if (bench.render && Bench_Selected("Render_SubmitFrame"))
+        {
+            Bench_Run("Render_SubmitFrame", count, Bench_DrawFrame);
+        }
+
+        Bench_RemoveObjects(count);
+
+        if (Bench_Selected("Util_FindNearItem"))
+        {
+            Bench_CreateObjects(TYPE_APPLE, count);
+            Bench_Run("Util_FindNearItem", count, Bench_FindNearItem);
+            Bench_RemoveObjects(count);
+        }
+
+        bench.typeId = TYPE_APPLE;
+
+        for (int i = 0; i < (int)(sizeof(REMOVED_PERCENTS) / sizeof(REMOVED_PERCENTS[0])); i++)
+        {
+            bench.removedPercent = REMOVED_PERCENTS[i];
+            snprintf(name, sizeof(name), "ObjectArray_Clean/%d%%", bench.removedPercent);
+
+            if (Bench_Selected(name))
+            {
+                Bench_Run(name, count, Bench_Clean);
+            }
+        }
+
+        if (Bench_Selected("Types_CreateObject"))
+        {
+            Bench_Run("Types_CreateObject", count, Bench_CreateObject);
+        }
+
+        free(bench.objects);
+        free(bench.startX);
+        free(bench.startY);
+        free(bench.cells);
+    }
+}
+
+
+// Results
+
+static bool Bench_WriteJson(const char* path, const char* note)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    // One result per line, Bench_ReadBaseline() depends on it
+    fprintf(file, "{\n");
+    if (note)
+    {
+        fprintf(file, "  \"note\": \"%s\",\n", note);
+    }
+    fprintf(file, "  \"results\": [\n");
+
+    for (int i = 0; i < bench.resultCount; i++)
+    {
+        const BenchResult* result = &bench.results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"count\": %d, \"ns_per_op\": %.3f, "
+            "\"objects_per_second\": %.0f, \"ns_per_round\": %.1f}%s\n",
+            result->name, result->count, result->nsPerOp, result->objectsPerSecond,
+            result->nsPerRound, i + 1 < bench.resultCount ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+// Reads the results written by Bench_WriteJson()
+static int Bench_ReadBaseline(const char* path, BenchResult* results, int maxCount)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return -1;
+    }
+
+    char line[512];
+    int count = 0;
+
+    while (count < maxCount && fgets(line, sizeof(line), file))
+    {
+        BenchResult* result = &results[count];
+
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"count\": %d, \"ns_per_op\": %lf",
+            result->name, &result->count, &result->nsPerOp) == 3)
+        {
+            count++;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+// Returns the count of the results slower than the baseline by more than
+// threshold. The results and the baseline entries without a pair are listed,
+// as a renamed or skipped benchmark is not compared.
+static int Bench_Compare(const char* path, double threshold)
+{
+    static BenchResult baseline[BENCH_MAX_RESULTS];
+    static bool compared[BENCH_MAX_RESULTS];
+    const int baselineCount = Bench_ReadBaseline(path, baseline, BENCH_MAX_RESULTS);
+
+    if (baselineCount < 0)
+    {
+        printf("Could not read the baseline %s\n", path);
+        return 0;
+    }
+
+    int regressions = 0;
+    printf("\nComparison with %s (regression if slower by more than %.0f%%):\n", path, threshold * 100);
+
+    for (int i = 0; i < bench.resultCount; i++)
+    {
+        const BenchResult* result = &bench.results[i];
+        int j = 0;
+
+        while (j < baselineCount && (baseline[j].count != result->count || strcmp(baseline[j].name, result->name) != 0))
+        {
+            j++;
+        }
+
+        if (j == baselineCount)
+        {
+            printf("%-28s %6d  not in the baseline\n", result->name, result->count);
+            continue;
+        }
+
+        const double change = result->nsPerOp / baseline[j].nsPerOp - 1;
+        const bool regression = change > threshold;
+        regressions += regression;
+        compared[j] = true;
+
+        printf("%-28s %6d %12.2f -> %10.2f ns/op %+7.1f%%%s\n",
+            result->name, result->count, baseline[j].nsPerOp, result->nsPerOp,
+            change * 100, regression ? "  REGRESSION" : "");
+    }
+
+    for (int j = 0; j < baselineCount; j++)
+    {
+        if (!compared[j])
+        {
+            printf("%-28s %6d  not run, only in the baseline\n", baseline[j].name, baseline[j].count);
+        }
+    }
+
+    return regressions;
+}
+
+
+static void printUsage(const char* program)
+{
+    printf("Usage: %s [--counts N,N,...] [--time S] [--filter TEXT] [--no-render] [--renderer NAME]\n"
+           "       [--json FILE] [--note TEXT] [--baseline FILE] [--threshold PERCENT]\n", program);
+    printf("  --counts N,N,... Object counts, 16,256,4096 by default\n");
+    printf("  --time S         Time of each benchmark in seconds, 0.2 by default\n");
+    printf("  --filter TEXT    Run only the benchmarks whose names contain TEXT\n");
+    printf("  --no-render      Skip Render_SubmitFrame (needs the image and font directories)\n");
+    printf("  --renderer NAME  Draw by sdl or raster, auto (raster on the software renderer) by default\n");
+    printf("  --json FILE      Write the results to FILE\n");
+    printf("  --note TEXT      Add the note (e.g. the machine) to the JSON\n");
+    printf("  --baseline FILE  Compare with the results in FILE, exit with 1 on regressions\n");
+    printf("  --threshold P    Slowdown in percent that is a regression, 15 by default\n");
+}
+
+static void Bench_ParseCounts(const char* text)
+{
+    bench.countCount = 0;
+
+    while (*text && bench.countCount < BENCH_MAX_COUNTS)
+    {
+        char* end;
+        const long count = strtol(text, &end, 10);
+
+        if (end == text)
+        {
+            break;
+        }
+        if (count > 0)
+        {
+            bench.counts[bench.countCount++] = count;
+        }
+
+        text = *end == ',' ? end + 1 : end;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* jsonPath = NULL;
+    const char* note = NULL;
+    const char* baselinePath = NULL;
+    double threshold = 0.15;
+    RenderBackend backend = RENDER_BACKEND_AUTO;
+
+    bench.minTime = 0.2;
+    bench.render = true;
+    Bench_ParseCounts("16,256,4096");
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--counts") == 0 && i + 1 < argc)
+        {
+            Bench_ParseCounts(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+        {
+            bench.minTime = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            bench.filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-render") == 0)
+        {
+            bench.render = false;
+        }
+        else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc
+            && Render_ParseBackend(argv[i + 1], &backend))
+        {
+            i += 1;
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--note") == 0 && i + 1 < argc)
+        {
+            note = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baselinePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+        {
+            threshold = strtod(argv[++i], NULL) / 100;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The drawing goes to the software renderer of a window that is not shown,
+    // so it measures the CPU side without a display or a GPU
+    if (bench.render)
+    {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+        SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+
+        if (SDL_Init(SDL_INIT_VIDEO) < 0 || TTF_Init() < 0)
+        {
+            printf("SDL could not initialize, the rendering is skipped: %s\n", SDL_GetError());
+            bench.render = false;
+        }
+        else
+        {
+            const RenderOptions renderOptions = {
+                .spritesPath = "image/sprites.bmp",
+                .fontPath = "font/PressStart2P.ttf",
+                .scale = WINDOW_SCALE,
+                .vsync = false,
+                .thread = false,
+                .backend = backend
+            };
+            Render_Init(&renderOptions);
+            printf("Rendering by %s\n", Render_GetBackendName());
+        }
+    }
+
+    Types_InitTypes();
+    Types_InitPlayer(&player);
+    Levels_Init(NULL);
+    Game_SetLevel(0, 0);
+
+    // One synthetic step, so move() has the usual delta time
+    FrameControl_InitSynthetic(FRAME_RATE, MAX_DELTA_TIME);
+    FrameControl_WaitForNextFrame();
+    FrameControl_NextStep();
+
+    Bench_RunAll();
+
+    if (jsonPath && !Bench_WriteJson(jsonPath, note))
+    {
+        printf("Could not write %s\n", jsonPath);
+    }
+
+    const int regressions = baselinePath ? Bench_Compare(baselinePath, threshold) : 0;
+
+    if (bench.render)
+    {
+        Render_Deinit();
+        TTF_Quit();
+    }
+    Levels_Deinit();
+    Broadphase_Deinit();
+    SDL_Quit();
+
+    return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
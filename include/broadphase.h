@@ -0,0 +1,30 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include "types.h"
+
+// Uniform grid of the level cells with the objects whose bodies overlap them.
+// It is rebuilt from the object positions by Broadphase_Build(), the objects
+// outside the level are kept in the border cells. The queries return at most
+// maxCount objects and the count of the returned ones.
+//
+// The grid is not updated until the next build, so it holds the objects and
+// the positions they had then: the objects spawned later are not found, and
+// the moved ones are found in their old cells. The game invalidates it at the
+// start of each step, and the first query after that builds it, so the steps
+// without queries do not build it at all.
+
+void Broadphase_Build(const Level* level);  // Skips the removed objects
+void Broadphase_Invalidate(const Level* level); // The next query builds the grid for the level
+void Broadphase_Deinit();
+int Broadphase_CountCell(int r, int c);     // Not less than Broadphase_QueryCell() returns
+int Broadphase_QueryCell(int r, int c, Object** result, int maxCount);
+int Broadphase_QueryBox(const Borders* box, Object** result, int maxCount); // Objects whose bodies overlap the box
+
+#endif // BROADPHASE_H
@@ -8,12 +8,48 @@
 #define FRAMECONTROL_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "scalar.h"
+
+enum {
+    FRAME_HISTOGRAM_BUCKET = 2, // ms
+    FRAME_HISTOGRAM_SIZE = 32   // The last bucket counts all longer frames
+};
+
+typedef struct {
+    uint64_t frameCount;
+    int windowFrameCount;       // Frames the window values are calculated over
+    double min;                 // ms, window
+    double max;                 //
+    double mean;                //
+    double p50;                 //
+    double p95;                 //
+    double p99;                 //
+    double p999;                //
+    double longest;             // ms, all frames
+    uint64_t clampedFrameCount; // Frames whose time was not fully simulated
+    uint64_t histogram[FRAME_HISTOGRAM_SIZE]; // Frame counts by time, all frames
+} FrameStats;
 
 void FrameControl_Init(uint8_t fps, uint64_t maxDeltaTime);
+void FrameControl_InitSynthetic(uint8_t fps, uint64_t maxDeltaTime); // No sleeping, the time advances by frames
+void FrameControl_SetFrameTime(uint64_t frameTime);  // ns, synthetic mode only
+void FrameControl_SetSyntheticPacing(bool pacing);
+void FrameControl_SetFixedStep(unsigned ticksPerSecond, int maxStepsPerFrame);
+void FrameControl_SetVsync(bool vsync);
 void FrameControl_Deinit();      // Must be called after startFrameControl(), before the program exits
 void FrameControl_WaitForNextFrame();
-uint64_t FrameControl_GetElapsedFrameTime(); // ms
+bool FrameControl_NextStep();
+void FrameControl_SetSubstep(int index, int count); // The delta time becomes the part index of count equal parts of the step
+double FrameControl_GetAlpha();              // Fraction of the next step elapsed, for rendering between steps
+uint64_t FrameControl_GetFrameTime();        // ns, duration of the last frame
+uint64_t FrameControl_GetElapsedFrameTime(); // ms, duration of the current step
+Scalar FrameControl_GetDeltaTime();          // Seconds, duration of the current step
 uint64_t FrameControl_GetElapsedTime();      // ms
 double FrameControl_GetCurrentFps();
+int64_t FrameControl_GetFrameLateness();     // ns, how late the last frame started, can be negative with vsync
+void FrameControl_GetStats(FrameStats* stats);
+void FrameControl_PrintReport(FILE* file);
 
 #endif // FRAMECONTROL_H
@@ -8,16 +8,51 @@
 #define GAME_H
 
 #include "types.h"
+#include "render.h"
+
+// Input of a frame, as a bit mask (see also replay.h)
+typedef enum {
+    GAME_KEY_LEFT = 1,
+    GAME_KEY_RIGHT = 2,
+    GAME_KEY_UP = 4,
+    GAME_KEY_DOWN = 8,
+    GAME_KEY_SPACE = 16,
+    GAME_KEY_F = 32,
+    GAME_KEY_QUIT = 64      // The window was closed
+} GameKey;
+
+typedef struct {
+    bool headless;          // No window, no rendering, no frame pacing
+    uint64_t frameLimit;    // Quit after this many frames, 0 - no limit
+    unsigned tickRate;      // Logic steps per second, 0 - one step per frame
+    bool vsync;             // Frames are presented at the display refresh
+    bool renderThread;      // Draw on a render thread, otherwise between the logic frames
+    int windowScale;        // Initial window size, in screen sizes
+    RenderBackend renderBackend;
+    bool frameReport;       // Print the frame timing report at exit
+    uint32_t seed;          // Random seed
+    const char* recordPath; // Record the session to this replay file, NULL - don't record
+    const char* replayPath; // Play this replay file instead of the keyboard, NULL - don't play
+    const char* tracePath;  // Write the trace zones here at exit and on F12, NULL - don't write
+    const char* worldPath;  // World source or compiled world, NULL - the default one
+    int threadCount;        // Threads of the object update, 0 - one per CPU
+} GameOptions;
 
 extern Level* level;
 extern Player player;
 
-void Game_Init();
+void Game_Init(const GameOptions* options);
 void Game_run();
 
 void Game_SetLevel(int r, int c);
 void Game_CompleteLevel();
 
+// Creates an object in the current level. During the object update (onFrame)
+// the object joins the level after the update of all objects, in the order of
+// the objects that spawned it, and is updated then. The returned pointer is
+// valid until the next spawn.
+Object* Game_SpawnObject(ObjectTypeId typeId);
+
 void Game_DamagePlayer(int damage);
 void Game_KillPlayer();
 
@@ -18,15 +18,46 @@ bool Util_IsWater(int r, int c);
 bool Util_CellContains(int r, int c, ObjectTypeId generalType);
 bool Util_HitTest(const Object* object1, const Object* object2);
 
+// Box moving along one axis through the level cells, see Util_Sweep()
+typedef struct {
+    int side;           // Side of the cells the box moves to: SOLID_LEFT - moves right, etc.
+    double edge;        // Coordinate of the leading box edge along the axis, before the move
+    double end;         // The same after the move, not behind the edge
+    int cell;           // Cell of the box center along the axis
+    int laneFirst;      // Cells the box covers across the axis, inclusive
+    int laneLast;       //
+} Sweep;
+
+typedef struct {
+    int r;              // The cell that stopped the box
+    int c;              //
+    double edge;        // Leading edge coordinate at the hit, may be behind the start
+    double time;        // Part of the move done before the hit, 0..1
+} SweepHit;
+
+// Returns true if the cell stops a box entering it through the side
+typedef bool (*SweepTest)(void* context, int r, int c, int side);
+
+bool Util_Sweep(const Sweep* sweep, SweepTest test, void* context, SweepHit* hit);
+
 void Util_GetObjectCell(const Object* object, int* r, int* c);
 void Util_GetObjectBody(const Object* object, Borders* body);
 void Util_GetObjectPos(const Object* object, int* r, int* c, Borders* cell, Borders* body);
 
 bool Util_FindNearDoor(int* r, int* c);
-Object* Util_FindNearItem(int r, int c);
+Object* Util_FindNearItem(int r, int c); // Of the objects in the broadphase grid, see broadphase.h
 Object* Util_FindObject(Level* level, ObjectTypeId typeId);
 
-double Util_LimitAbs(double value, double max);
+void Util_SeedRandom(uint32_t seed);
+int Util_Random(); // 0..INT32_MAX, same sequence for the same seed on any platform
+
+// Until Util_EndRandomStream(), Util_Random() on this thread gives its own
+// sequence, defined by the seed and the stream number only, so the objects
+// updated in parallel get the same numbers on any thread
+void Util_BeginRandomStream(uint32_t seed, uint32_t stream);
+void Util_EndRandomStream();
+
+Scalar Util_LimitAbs(Scalar value, Scalar max);
 void Util_EnsureSDL(int condition, const char* message);
 
 #endif // HELPERS_H
@@ -0,0 +1,31 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#ifndef HITBATCH_H
+#define HITBATCH_H
+
+#include "types.h"
+
+// Bodies of many objects, stored as arrays of the centers and half sizes, so
+// one object can be tested against several of them at once. The results are
+// the same as of Util_HitTest().
+typedef struct {
+    double* centerX;
+    double* centerY;
+    double* halfW;
+    double* halfH;
+    Object** objects;
+    Object** hits;      // Filled by HitBatch_Test()
+    int count;
+    int reserved;
+} HitBatch;
+
+void HitBatch_Init(HitBatch* batch);
+void HitBatch_Free(HitBatch* batch);
+void HitBatch_Build(HitBatch* batch, const ObjectArray* objects, const Object* skip); // Skips the removed objects too
+int HitBatch_Test(HitBatch* batch, const Object* object); // Returns the count of batch->hits, in the batch order
+
+#endif // HITBATCH_H
@@ -0,0 +1,24 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#ifndef JOBS_H
+#define JOBS_H
+
+// Pool of worker threads for the data parallel parts of a step. Jobs_Run()
+// calls the function for each index, on the workers and on the calling
+// thread, and returns when all calls are done. Any thread may take any index,
+// so the results must not depend on it. Several threads may call Jobs_Run(),
+// but the workers take one run at a time, and the others are done by their
+// calling threads alone.
+
+typedef void (*JobFunction)(void* context, int index);
+
+void Jobs_Init(int threadCount);    // Threads including the calling one, 1 - no workers
+void Jobs_Deinit();
+int Jobs_GetThreadCount();
+void Jobs_Run(JobFunction function, void* context, int count);
+
+#endif // JOBS_H
@@ -9,13 +9,24 @@
 
 #include "types.h"
 
-enum {
-    LEVEL_COUNTX = 2,
-    LEVEL_COUNTY = 2
-};
+// World loaded when no other is given, see world.h
+#define LEVELS_DEFAULT_WORLD "levels/world.txt"
 
-extern Level levels[LEVEL_COUNTY][LEVEL_COUNTX];
+// The world can be much larger than the memory for its levels. A level is
+// created from the world when it is needed, and only the last used levels
+// stay resident. The others, if they were played, are saved (the cells and
+// the objects, as they are) and restored when needed again, without calling
+// onInit(), so the game goes on exactly as if all levels were resident. The
+// levels that were not played are created again. At least the level of the
+// player and its four neighbours, which Levels_Prefetch() loads, are resident.
+enum { LEVEL_RESIDENT_MIN = 5, LEVEL_RESIDENT_MAX = 16 };
 
-void Levels_Init();
+void Levels_Init(const char* worldPath);    // NULL for LEVELS_DEFAULT_WORLD
+void Levels_Deinit();
+void Levels_SetResidentLimit(int count);    // LEVEL_RESIDENT_MIN..LEVEL_RESIDENT_MAX, LEVEL_RESIDENT_MAX by default
+int Levels_GetCountX();                     // Size of the world, in levels
+int Levels_GetCountY();                     //
+Level* Levels_Get(int r, int c);            // Makes the level resident, NULL outside the world
+void Levels_Prefetch(int r, int c);         // Makes the neighbours of the level resident
 
 #endif // LEVELS_H
@@ -9,6 +9,18 @@
 
 #include "types.h"
 
+typedef enum {
+    HITTEST_NONE = 0,
+    HITTEST_WALLS = 1,
+    HITTEST_FLOOR = 2,
+    HITTEST_LEVEL = 4,
+    HITTEST_ALL = HITTEST_WALLS | HITTEST_FLOOR | HITTEST_LEVEL
+} HitTest;
+
+// The helpers of the handlers, for the benchmarks (see bench/bench.c)
+int Object_Move(Object* object, int hitTest);       // Returns the directions the object could not fully move to
+bool Object_IsVisible(Object* source, Object* target);
+
 void Object_onInit(Object* object);
 void Object_onFrame(Object* object);
 void Object_onHit(Object* object);
@@ -0,0 +1,82 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Software rasterizer for the hosts without a GPU, where SDL draws each sprite
+// by its generic software renderer. The images are ARGB8888 in memory, and the
+// sprites are copied by AVX2 or SSE2 kernels, depending on what the compiler
+// targets (e.g. -mavx2 or -march=native), or by plain loops otherwise.
+//
+// The source pixels with alpha 0 are transparent (the colour key), and the
+// rest are opaque, optionally blended with the target by a constant alpha.
+
+typedef struct {
+    uint32_t* pixels;   // ARGB8888, row by row
+    int width;
+    int height;
+} RasterImage;
+
+bool Raster_CreateImage(RasterImage* image, int width, int height);
+bool Raster_CreateImageFromSurface(RasterImage* image, SDL_Surface* surface); // The colour key becomes alpha 0
+void Raster_FreeImage(RasterImage* image);
+
+void Raster_FillRect(RasterImage* target, SDL_Rect rect, SDL_Color color);
+void Raster_Copy(RasterImage* target, const RasterImage* source, int x, int y);  // Opaque, the whole source
+void Raster_Blit(RasterImage* target, const RasterImage* source, SDL_Rect sourceRect,
+                 int x, int y, SDL_RendererFlip flip, int alpha);
+const char* Raster_GetKernelName();     // "avx2", "sse2" or "scalar"
+
+// Draw commands of a frame, recorded in order, and then executed by bands of
+// rows on the job pool (see jobs.h). Each command is binned to the bands its
+// rows overlap, and each band executes its commands in the recorded order, so
+// the result is exactly the same as of the commands executed one by one.
+typedef enum {
+    RASTER_COMMAND_BLIT,
+    RASTER_COMMAND_FILL,
+    RASTER_COMMAND_COPY
+} RasterCommandType;
+
+typedef struct {
+    RasterCommandType type;
+    const RasterImage* source;  // Blit, copy
+    SDL_Rect rect;              // Source rect of a blit or a copy, target rect of a fill
+    int x;                      // Blit, copy
+    int y;                      //
+    SDL_RendererFlip flip;      // Blit
+    int alpha;                  //
+    SDL_Color color;            // Fill
+} RasterCommand;
+
+typedef struct {
+    int* commands;              // Indices in RasterCommandList::commands
+    int count;
+    int reserved;
+} RasterBin;
+
+enum { RASTER_BAND_MAX = 64 };
+
+typedef struct {
+    RasterCommand* commands;
+    int count;
+    int reserved;
+    RasterBin bins[RASTER_BAND_MAX];
+} RasterCommandList;
+
+void Raster_InitCommands(RasterCommandList* list);
+void Raster_FreeCommands(RasterCommandList* list);
+void Raster_AddBlit(RasterCommandList* list, const RasterImage* source, SDL_Rect sourceRect,
+                    int x, int y, SDL_RendererFlip flip, int alpha);
+void Raster_AddFill(RasterCommandList* list, SDL_Rect rect, SDL_Color color);
+void Raster_AddCopy(RasterCommandList* list, const RasterImage* source, int x, int y);
+void Raster_ExecuteCommands(RasterCommandList* list, RasterImage* target, int bandHeight);  // And clears the list
+
+#endif // RASTER_H
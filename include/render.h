@@ -9,14 +9,43 @@
 
 #include "types.h"
 
-extern SDL_Renderer* renderer;
+// The drawing does not read the game state: each frame the logic captures what
+// to draw (the cells, the object sprites, the message) into a frame, and
+// Render_SubmitFrame() passes it to the render thread through a triple buffer.
+// The render thread owns the renderer and draws the newest frame, so a slow
+// present does not delay the logic, and the frames it misses are skipped.
+// Without the thread, the frame is drawn and presented on the calling thread.
+//
+// The frame shows a view of the level, SCREEN_WIDTH x SCREEN_HEIGHT, that
+// follows the player and stops at the level borders. Only the cells and the
+// objects in the view are drawn. The frame is then scaled to the window by an
+// integer factor. The window can be resized.
 
-void Render_Init(const char* spritesPath, const char* fontPath);
+typedef enum {
+    RENDER_BACKEND_AUTO,    // The rasterizer if SDL has only its software renderer
+    RENDER_BACKEND_SDL,     // The renderer draws the sprites
+    RENDER_BACKEND_RASTER   // The in-tree rasterizer draws the frame, see raster.h
+} RenderBackend;
+
+typedef struct {
+    const char* spritesPath;
+    const char* fontPath;
+    int scale;              // Initial window size, in screen sizes
+    bool vsync;             // Present at the display refresh
+    bool thread;            // Draw on the render thread
+    RenderBackend backend;
+} RenderOptions;
+
+bool Render_ParseBackend(const char* name, RenderBackend* backend); // "auto", "sdl" or "raster"
+void Render_Init(const RenderOptions* options);
 void Render_Deinit();
-void Render_DrawSprite(SDL_Rect spriteRect, int x, int y, int frame, SDL_RendererFlip flip);
-void Render_DrawObject(const Object* object);
-void Render_DrawMessage(MessageId message);
-void Render_DrawScreen();
+void Render_Pause();    // Returns when the render thread has drawn its frame, and it draws no more
+void Render_Resume();   // Until this
+bool Render_IsVsync();
+bool Render_IsThreaded();
+const char* Render_GetBackendName();    // "sdl", or the rasterizer kernels: "avx2", "sse2", "scalar"
+void Render_SubmitFrame(MessageId message); // Captures the view of the current level, MESSAGE_NONE - no message
+void Render_AnimateObjects(); // Advances the animations of the current level objects
 void Render_SetAnimation(Object* object, int frameStart, int frameEnd, int fps);
 void Render_SetAnimationWave(Object* object, int fps);
 void Render_SetAnimationFlip(Object* object, int frame, int fps);
@@ -0,0 +1,37 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A replay is everything the game state depends on: the random seed, the tick
+// rate, and for each frame the pressed keys and the frame duration. Played
+// back, it gives exactly the same session, with or without a window.
+//
+// File format, little endian: the header "PLRP", version, seed and tick rate
+// (uint32 each), then 5 bytes per frame: keys (uint8) and duration (uint32,
+// ns). A longer frame has the high bit of the keys set and a uint64 duration,
+// so the keys can use only the lower 7 bits.
+
+typedef struct {
+    uint32_t seed;
+    uint32_t tickRate;
+} ReplayHeader;
+
+bool Replay_StartRecording(const char* path, const ReplayHeader* header);
+bool Replay_StartPlayback(const char* path, ReplayHeader* header);
+void Replay_Stop();             // Closes the file, if any
+
+bool Replay_IsRecording();
+bool Replay_IsPlaying();
+
+void Replay_RecordFrame(uint8_t keys, uint64_t frameTime);      // frameTime in ns
+bool Replay_PlayFrame(uint8_t* keys, uint64_t* frameTime);      // Returns false at the end
+
+#endif // REPLAY_H
@@ -0,0 +1,85 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#ifndef SCALAR_H
+#define SCALAR_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Type of the object positions, speeds and animation times. By default it is
+// double. With PLATFORMER_FIXED_POINT it is Q16.16 fixed point, so the game
+// state does not depend on the compiler or the floating point settings.
+//
+// Scalars can be added, subtracted and compared with each other, and multiplied
+// or divided by an int. Everything else goes through the functions below, including the
+// constants, which are written as SCALAR(value).
+
+#ifdef PLATFORMER_FIXED_POINT
+
+typedef int32_t Scalar;
+
+enum { SCALAR_FRACTION_BITS = 16 };
+
+#define SCALAR_ONE (1 << SCALAR_FRACTION_BITS)
+#define SCALAR(value) ((Scalar)((value) * SCALAR_ONE))
+#define SCALAR_MAX INT32_MAX
+
+static inline Scalar Scalar_FromInt(int value)
+{
+    return value * SCALAR_ONE;
+}
+
+// Rounds to nearest, so the exact values stay exact
+static inline Scalar Scalar_FromDouble(double value)
+{
+    return (Scalar)(value * SCALAR_ONE + (value < 0 ? -0.5 : 0.5));
+}
+
+static inline double Scalar_ToDouble(Scalar value)
+{
+    return (double)value / SCALAR_ONE;
+}
+
+// Rounds towards zero, as a double to int conversion does
+static inline int Scalar_ToInt(Scalar value)
+{
+    return value / SCALAR_ONE;
+}
+
+static inline Scalar Scalar_Mul(Scalar a, Scalar b)
+{
+    return (Scalar)(((int64_t)a * b) / SCALAR_ONE);
+}
+
+static inline Scalar Scalar_Div(Scalar a, Scalar b)
+{
+    return (Scalar)(((int64_t)a * SCALAR_ONE) / b);
+}
+
+static inline Scalar Scalar_Abs(Scalar value)
+{
+    return value < 0 ? -value : value;
+}
+
+#else
+
+typedef double Scalar;
+
+#define SCALAR(value) ((Scalar)(value))
+#define SCALAR_MAX HUGE_VAL
+
+static inline Scalar Scalar_FromInt(int value) { return value; }
+static inline Scalar Scalar_FromDouble(double value) { return value; }
+static inline double Scalar_ToDouble(Scalar value) { return value; }
+static inline int Scalar_ToInt(Scalar value) { return (int)value; }
+static inline Scalar Scalar_Mul(Scalar a, Scalar b) { return a * b; }
+static inline Scalar Scalar_Div(Scalar a, Scalar b) { return a / b; }
+static inline Scalar Scalar_Abs(Scalar value) { return value < 0 ? -value : value; }
+
+#endif // PLATFORMER_FIXED_POINT
+
+#endif // SCALAR_H
@@ -0,0 +1,47 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+// Timing zones for profiling. A zone is the code between TRACE_BEGIN() and
+// TRACE_END() of the same thread, zones can be nested. Each thread records
+// its zones into its own ring buffer, allocated at its first zone, so only
+// the last TRACE_RING_SIZE zones of a thread are kept. Trace_Export() writes
+// them in the Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+//
+// Without PLATFORMER_TRACE the macros are empty and Trace_Export() does
+// nothing, so the zones cost nothing.
+
+#ifdef PLATFORMER_TRACE
+
+enum { TRACE_ENABLED = 1 };
+
+void Trace_Begin(const char* name, int arg);    // name must be a static string
+void Trace_End();
+void Trace_SetThreadName(const char* name);     // name must be a static string
+bool Trace_Export(const char* path);            // Other threads should not record meanwhile
+
+#define TRACE_BEGIN(name) Trace_Begin(name, -1)
+#define TRACE_BEGIN_ARG(name, arg) Trace_Begin(name, arg) // The zone is named "name:arg"
+#define TRACE_END() Trace_End()
+
+#else
+
+enum { TRACE_ENABLED = 0 };
+
+static inline void Trace_SetThreadName(const char* name) { (void)name; }
+static inline bool Trace_Export(const char* path) { (void)path; return false; }
+
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_BEGIN_ARG(name, arg) ((void)0)
+#define TRACE_END() ((void)0)
+
+#endif // PLATFORMER_TRACE
+
+#endif // TRACE_H
@@ -11,26 +11,28 @@
 #include <stdbool.h>
 #include <SDL2/SDL.h>
 #include "List.h"
+#include "scalar.h"
 
 //#define DEBUG_MODE
 
 typedef enum {
-    LEVEL_WIDTH = 320,
-    LEVEL_HEIGHT = 240,
+    SCREEN_WIDTH = 320,
+    SCREEN_HEIGHT = 240,
     SPRITE_SIZE = 16,
     CELL_SIZE = SPRITE_SIZE,
     CELL_HALF = CELL_SIZE / 2,
-    ROW_COUNT = (LEVEL_HEIGHT + CELL_SIZE - 1) / CELL_SIZE,
-    COLUMN_COUNT = (LEVEL_WIDTH + CELL_SIZE - 1) / CELL_SIZE,
-    CELL_COUNT = ROW_COUNT * COLUMN_COUNT,
-    SIZE_FACTOR = 2,
+    SCREEN_ROW_COUNT = (SCREEN_HEIGHT + CELL_SIZE - 1) / CELL_SIZE,
+    SCREEN_COLUMN_COUNT = (SCREEN_WIDTH + CELL_SIZE - 1) / CELL_SIZE,
+    LEVEL_SIZE_MIN = 2,   // Rows or columns of a level
+    LEVEL_SIZE_MAX = 256, // So that a cell coordinate fits a byte
+    WINDOW_SCALE = 2, // Default window size, in screen sizes
     FRAME_RATE = 48  // If <= 0, renders without upper fps limit
 } Constant;
 
-extern const uint64_t MAX_DELTA_TIME; // Maximum delta time at which the hit test still works, milliseconds
-extern const uint64_t MAX_SPEED;      // Maximum speed at which the hit test still works, pixels per second
+extern const uint64_t MAX_DELTA_TIME; // Maximum delta time of a step, longer frames slow the game down, milliseconds
 
 typedef enum {
+    MESSAGE_NONE = -1,
     MESSAGE_PLAYER_KILLED = 0,
     MESSAGE_GAME_OVER,
     MESSAGE_LEVEL_COMPLETE,
@@ -108,6 +110,8 @@ typedef enum {
     TYPE_SPIKE
 } ObjectTypeId;
 
+_Static_assert(TYPE_COUNT <= 256, "The tile ids of the levels are stored in uint8_t");
+
 typedef enum {
     SOLID_LEFT = 1,
     SOLID_RIGHT = 2,
@@ -116,6 +120,14 @@ typedef enum {
     SOLID_ALL = SOLID_LEFT | SOLID_RIGHT | SOLID_TOP | SOLID_BOTTOM
 } SolidFlags;
 
+// Level cell flags, extend SolidFlags
+typedef enum {
+    CELL_LADDER = 16,
+    CELL_WATER = 32,
+    CELL_SPIKE = 64,
+    CELL_DOOR = 128
+} CellFlags;
+
 typedef struct {
     double left;
     double right;
@@ -135,7 +147,7 @@ typedef struct {
     SDL_Rect sprite; // Sprite rect in the spritesheet, unscaled
     SDL_Rect body;   // Body rect relative to the object (x, y), unscaled
     int solid;
-    double speed;
+    Scalar speed;
     OnInit onInit;
     OnFrame onFrame;
     OnHit onHit;
@@ -152,8 +164,8 @@ typedef struct {
     int frame;
     int frameStart;
     int frameEnd;
-    double frameDelay;          // Seconds
-    double frameDelayCounter;   // Seconds
+    Scalar frameDelay;          // Seconds
+    Scalar frameDelayCounter;   // Seconds
     SDL_RendererFlip flip;
     int alpha;
 } Animation;
@@ -161,39 +173,58 @@ typedef struct {
 typedef struct Object_s {
     ObjectType* type;
     Animation anim;
-    double x;
-    double y;
-    double vx;      // Pixels per second
-    double vy;      // Pixels per second
+    Scalar x;
+    Scalar y;
+    Scalar vx;      // Pixels per second
+    Scalar vy;      // Pixels per second
+    Scalar prevX;   // Position before the last logic step, for rendering between steps
+    Scalar prevY;   //
     bool removed;
     int state;
     int data;
 } Object;
 
-// typedef struct {
-//     Object** array;
-//     int reserved;
-//     int count;
-// } ObjectArray;
+// Objects of a level are allocated from its pool, which takes memory from the
+// system by slabs and never returns it until the level is deinitialized. The
+// freed slots are reused, so after the first frames no memory is allocated.
+enum { OBJECT_SLAB_SIZE = 64 }; // Objects
 
-// typedef struct ObjectListNode {
-//     Object* data;
-//     struct ObjectListNode* next;
-// } ObjectListNode;
+typedef union ObjectSlot_s {
+    Object object;
+    union ObjectSlot_s* next;   // When the slot is free
+} ObjectSlot;
+
+typedef struct ObjectSlab_s {
+    struct ObjectSlab_s* next;
+    ObjectSlot slots[OBJECT_SLAB_SIZE];
+} ObjectSlab;
+
+typedef struct {
+    ObjectSlab* slabs;          // All slabs, the next slabs are not used yet after a reset
+    ObjectSlab* slab;           // Slab where the new slots are taken from
+    int slabUsed;               // Slots taken from this slab
+    ObjectSlot* free;           // Freed slots
+    int used;                   // Objects allocated now
+    int slabCount;
+} ObjectPool;
 
-// typedef struct {
-//     ObjectListNode* first;
-//     ObjectListNode* last;
-// } ObjectList;
+// Objects are stored as pointers, so they keep their addresses when the array grows
+typedef struct {
+    Object** array;
+    int reserved;
+    int count;
+} ObjectArray;
 
 // Player inherits Object, so must begin with its fields
 typedef struct {
     ObjectType* type;
     Animation anim;
-    double x;
-    double y;
-    double vx;
-    double vy;
+    Scalar x;
+    Scalar y;
+    Scalar vx;
+    Scalar vy;
+    Scalar prevX;
+    Scalar prevY;
     bool removed;       // Unused
     int state;          // Unused
     int data;           // Unused
@@ -207,34 +238,65 @@ typedef struct {
     List items;
 } Player;
 
+// A level is LEVEL_SIZE_MIN..LEVEL_SIZE_MAX cells in each direction, and the
+// screen shows its part around the player
 typedef struct {
-    ObjectType* cells[ROW_COUNT][COLUMN_COUNT];
-    List objects;
+    uint8_t* tiles;             // ObjectTypeId of the cells, row by row, see Level_GetCellType()
+    uint8_t* cellFlags;         // SolidFlags and CellFlags of the cells, for the hit tests
+    int rowCount;
+    int columnCount;
+    ObjectArray objects;        // The player is always the first
+    ObjectPool pool;            // Memory of the objects, except the player
     int r;
     int c;
     void (*init)();
+    uint32_t tilesRevision;     // Unique, changes with the cells or their sprites, see Types_InvalidateTiles()
+    bool played;                // Was the current level, so it may differ from the world
 } Level;
 
-// void ObjectArray_init(ObjectArray* objects);
-// void ObjectArray_append(ObjectArray* objects, Object* object);
-// void ObjectArray_free(ObjectArray* objects);
-// void ObjectArray_clean(ObjectArray* objects);
-// void ObjectArray_sortByDepth(ObjectArray* objects);
-
-// void ObjectList_init(ObjectList* objs);
-// void ObjectList_append(ObjectList* objects, Object* object);
-// void ObjectList_free(ObjectList* objs);
-// void ObjectList_clean(ObjectList* objs);
+void ObjectArray_Init(ObjectArray* objects);
+void ObjectArray_Append(ObjectArray* objects, Object* object);
+void ObjectArray_Free(ObjectArray* objects);  // Does not free the objects
+void ObjectArray_Clean(ObjectArray* objects, ObjectPool* pool); // Frees the removed objects, the order of the rest changes
 
-void Types_ClearList(List* list);
+void ObjectPool_Init(ObjectPool* pool);
+Object* ObjectPool_Alloc(ObjectPool* pool);
+void ObjectPool_Release(ObjectPool* pool, Object* object);
+void ObjectPool_Reset(ObjectPool* pool);    // Releases all objects at once, keeps the memory
+void ObjectPool_Free(ObjectPool* pool);     // Returns the memory to the system
 
 void Types_CreateStaticObject(Level* level, ObjectTypeId typeId, int r, int c);
+void Types_SetTiles(Level* level, const uint8_t* tiles);   // rowCount * columnCount ids, row by row
+void Types_InvalidateTiles(Level* level);  // The cells or their sprites changed, so they are drawn anew
 Object* Types_CreateObject(Level* level, ObjectTypeId typeId, int r, int c);
 void Types_InitObject(Object* object, ObjectTypeId typeId);
 void Types_InitPlayer(Player* player);
-void Types_InitLevel(Level* level);
+void Types_InitLevel(Level* level, int rowCount, int columnCount);
+void Types_ResetLevel(Level* level);       // Releases the objects, keeps the memory
+void Types_DeinitLevel(Level* level);
 void Types_InitTypes();
 
 extern ObjectType objectTypes[TYPE_COUNT];
 
+// Index of the cell in Level::tiles and Level::cellFlags
+static inline int Level_GetCell(const Level* level, int r, int c)
+{
+    return r * level->columnCount + c;
+}
+
+static inline ObjectType* Level_GetCellType(const Level* level, int r, int c)
+{
+    return &objectTypes[level->tiles[Level_GetCell(level, r, c)]];
+}
+
+static inline int Level_GetWidth(const Level* level)    // Pixels
+{
+    return level->columnCount * CELL_SIZE;
+}
+
+static inline int Level_GetHeight(const Level* level)   // Pixels
+{
+    return level->rowCount * CELL_SIZE;
+}
+
 #endif // TYPES_H
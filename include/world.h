@@ -0,0 +1,70 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "types.h"
+
+// A world is a grid of levels of the same size. Its source is a text file, a
+// character per cell: each line is a row of cells of all levels of a world
+// row, and the lines starting with '#' are comments. The lines shorter than
+// the longest one are padded with spaces. A level is a screen by default, and
+// a line "#level <columns> <rows>" before the cells sets another size, of
+// LEVEL_SIZE_MIN..LEVEL_SIZE_MAX cells each way. The level compiler
+// (platformer_levelc) turns it into a compiled world, where the tile variants
+// are already resolved from their neighbours, and the game decodes a level
+// from it without any parsing.
+//
+// Compiled world, little endian, uint32 values:
+// - header: "PLWD", version, TYPE_COUNT, row and column count of a level,
+//   level count x and y, start row and column of the player in the world cells
+// - level index, row by row: offset of the level data and spawn count
+// - level data: row count * column count tile ids (uint8, ObjectTypeId), then
+//   the spawns
+//
+// The compiled world is valid only for the ObjectTypeId values it was made
+// with, so it is rejected when TYPE_COUNT differs.
+
+enum { WORLD_VERSION = 1 };
+
+// Object created with the level, in the order of the cells
+typedef struct {
+    uint8_t r;
+    uint8_t c;
+    uint8_t typeId;         // ObjectTypeId
+    uint8_t data;           // Object data of TYPE_ACTION
+} WorldSpawn;
+
+typedef struct {
+    const uint8_t* data;    // Compiled world
+    size_t size;
+    bool mapped;            // The data is a mapped file, otherwise allocated
+    int rowCount;           // Size of a level, in cells
+    int columnCount;        //
+    int countX;             // Levels
+    int countY;             //
+    int startR;             // Start cell of the player, in the world cells
+    int startC;             //
+} World;
+
+// Compiles the source text. The result is allocated, free() it.
+bool World_Compile(const char* source, size_t size, uint8_t** data, size_t* dataSize);
+
+// Opens a compiled world, mapped, or a source, compiled in memory, depending
+// on the file contents. The world is checked here, so the game can use it as is.
+bool World_Open(World* world, const char* path);
+void World_Close(World* world);
+
+const uint8_t* World_GetTiles(const World* world, int r, int c);   // rowCount * columnCount tile ids
+const WorldSpawn* World_GetSpawns(const World* world, int r, int c, int* count);
+
+const char* World_GetError();   // Why the last World_Compile() or World_Open() failed
+
+#endif // WORLD_H
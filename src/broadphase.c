@@ -0,0 +1,260 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#include "broadphase.h"
+#include "helpers.h"
+#include <math.h>
+
+// Cells an object overlaps, inclusive
+typedef struct {
+    int r0, c0;
+    int r1, c1;
+} CellRange;
+
+typedef struct {
+    Object* object;
+    CellRange range;
+} GridEntry;
+
+// The entries are sorted by cells, entries of the cell i are in
+// [cellStart[i], cellStart[i + 1]). The arrays only grow, so after the first
+// frames the build allocates nothing.
+static struct {
+    const Level* level;     // To build the grid for on the next query, if stale
+    bool stale;             //
+    int rowCount;           // Of the level the grid was built for
+    int columnCount;        //
+    int* cellStart;         // rowCount * columnCount + 1
+    int cellStartReserved;
+    GridEntry* entries;
+    int entryCount;
+    int entriesReserved;
+    GridEntry* objects;     // Non-removed objects with their ranges, in the build order
+    int objectsReserved;
+} grid;
+
+static inline int Broadphase_Clamp(int value, int min, int max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+static CellRange Broadphase_GetRange(const Borders* box)
+{
+    return (CellRange) {
+        .r0 = Broadphase_Clamp(floor(box->top / CELL_SIZE), 0, grid.rowCount - 1),
+        .c0 = Broadphase_Clamp(floor(box->left / CELL_SIZE), 0, grid.columnCount - 1),
+        .r1 = Broadphase_Clamp(floor(box->bottom / CELL_SIZE), 0, grid.rowCount - 1),
+        .c1 = Broadphase_Clamp(floor(box->right / CELL_SIZE), 0, grid.columnCount - 1)
+    };
+}
+
+static void* Broadphase_Reserve(void* array, int* reserved, int count, size_t size)
+{
+    if (count > *reserved)
+    {
+        void* grown = realloc(array, count * 2 * size);
+        Util_EnsureSDL(grown != NULL, "Could not reserve the broadphase grid.");
+        array = grown;
+        *reserved = count * 2;
+    }
+    return array;
+}
+
+void Broadphase_Build(const Level* level)
+{
+    const ObjectArray* objects = &level->objects;
+    const int cellCount = level->rowCount * level->columnCount;
+    int objectCount = 0;
+    int entryCount = 0;
+
+    grid.level = level;
+    grid.stale = false;
+    grid.rowCount = level->rowCount;
+    grid.columnCount = level->columnCount;
+    grid.cellStart = Broadphase_Reserve(grid.cellStart, &grid.cellStartReserved, cellCount + 1, sizeof(int));
+    grid.objects = Broadphase_Reserve(grid.objects, &grid.objectsReserved, objects->count, sizeof(GridEntry));
+    int* cellStart = grid.cellStart;
+
+    for (int i = 0; i <= cellCount; i++)
+    {
+        cellStart[i] = 0;
+    }
+
+    // Count the entries of each cell, in the next cell's start
+    for (int i = 0; i < objects->count; i++)
+    {
+        Object* object = objects->array[i];
+
+        if (object->removed)
+        {
+            continue;
+        }
+
+        Borders body;
+        Util_GetObjectBody(object, &body);
+
+        const CellRange range = Broadphase_GetRange(&body);
+        grid.objects[objectCount++] = (GridEntry) {object, range};
+
+        for (int r = range.r0; r <= range.r1; r++)
+        {
+            for (int c = range.c0; c <= range.c1; c++)
+            {
+                cellStart[r * grid.columnCount + c + 1] += 1;
+            }
+        }
+
+        entryCount += (range.r1 - range.r0 + 1) * (range.c1 - range.c0 + 1);
+    }
+
+    for (int i = 0; i < cellCount; i++)
+    {
+        cellStart[i + 1] += cellStart[i];
+    }
+
+    grid.entries = Broadphase_Reserve(grid.entries, &grid.entriesReserved, entryCount, sizeof(GridEntry));
+    grid.entryCount = entryCount;
+
+    // Place the entries, each cell start is advanced and then restored
+    for (int i = 0; i < objectCount; i++)
+    {
+        const CellRange range = grid.objects[i].range;
+
+        for (int r = range.r0; r <= range.r1; r++)
+        {
+            for (int c = range.c0; c <= range.c1; c++)
+            {
+                grid.entries[cellStart[r * grid.columnCount + c]++] = grid.objects[i];
+            }
+        }
+    }
+
+    for (int i = cellCount; i > 0; i--)
+    {
+        cellStart[i] = cellStart[i - 1];
+    }
+    cellStart[0] = 0;
+}
+
+void Broadphase_Invalidate(const Level* level)
+{
+    grid.level = level;
+    grid.stale = true;
+}
+
+static void Broadphase_Update()
+{
+    if (grid.stale)
+    {
+        Broadphase_Build(grid.level);
+    }
+}
+
+void Broadphase_Deinit()
+{
+    free(grid.cellStart);
+    free(grid.entries);
+    free(grid.objects);
+    grid.cellStart = NULL;
+    grid.entries = NULL;
+    grid.objects = NULL;
+    grid.level = NULL;
+    grid.stale = false;
+    grid.rowCount = 0;
+    grid.columnCount = 0;
+    grid.cellStartReserved = 0;
+    grid.entryCount = 0;
+    grid.entriesReserved = 0;
+    grid.objectsReserved = 0;
+}
+
+int Broadphase_CountCell(int r, int c)
+{
+    Broadphase_Update();
+
+    if ((unsigned)r >= (unsigned)grid.rowCount || (unsigned)c >= (unsigned)grid.columnCount)
+    {
+        return 0;
+    }
+
+    // Including the objects removed since the build
+    const int cell = r * grid.columnCount + c;
+    return grid.cellStart[cell + 1] - grid.cellStart[cell];
+}
+
+int Broadphase_QueryCell(int r, int c, Object** result, int maxCount)
+{
+    Broadphase_Update();
+
+    if ((unsigned)r >= (unsigned)grid.rowCount || (unsigned)c >= (unsigned)grid.columnCount)
+    {
+        return 0;
+    }
+
+    const int cell = r * grid.columnCount + c;
+    int count = 0;
+
+    for (int i = grid.cellStart[cell]; i < grid.cellStart[cell + 1] && count < maxCount; i++)
+    {
+        Object* object = grid.entries[i].object;
+
+        if (!object->removed)
+        {
+            result[count++] = object;
+        }
+    }
+
+    return count;
+}
+
+int Broadphase_QueryBox(const Borders* box, Object** result, int maxCount)
+{
+    Broadphase_Update();
+
+    const CellRange range = Broadphase_GetRange(box);
+    int count = 0;
+
+    for (int r = range.r0; r <= range.r1; r++)
+    {
+        for (int c = range.c0; c <= range.c1; c++)
+        {
+            const int cell = r * grid.columnCount + c;
+
+            for (int i = grid.cellStart[cell]; i < grid.cellStart[cell + 1]; i++)
+            {
+                const GridEntry* entry = &grid.entries[i];
+
+                // An object is in several cells, so it is reported only in the
+                // first cell where it and the box overlap
+                if (r != (entry->range.r0 > range.r0 ? entry->range.r0 : range.r0) ||
+                    c != (entry->range.c0 > range.c0 ? entry->range.c0 : range.c0))
+                {
+                    continue;
+                }
+
+                if (entry->object->removed)
+                {
+                    continue;
+                }
+
+                Borders body;
+                Util_GetObjectBody(entry->object, &body);
+
+                if (body.left < box->right && body.right > box->left &&
+                    body.top < box->bottom && body.bottom > box->top)
+                {
+                    if (count == maxCount)
+                    {
+                        return count;
+                    }
+                    result[count++] = entry->object;
+                }
+            }
+        }
+    }
+
+    return count;
+}
@@ -11,19 +11,76 @@
 #include "helpers.h"
 
 #include <time.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+enum { NS_PER_US = 1000, NS_PER_MS = 1000000, NS_PER_SECOND = 1000000000 };
+
+enum { FRAME_HISTORY = 1024 }; // Frames in the statistics window
+
+// The sleep may end later than requested (by up to the scheduler quantum on a
+// loaded system), so the last part of the wait is spinning
+static const uint64_t SPIN_TIME = 500 * NS_PER_US;
 
 static struct {
-    uint64_t startTime;
-    uint64_t prevFrameTime;
-    uint64_t elapsedFrameTime;
-    uint64_t framePeriod;
+    uint64_t startCounter;
+    uint64_t counterFrequency;
+    uint64_t startTime;         // ns
+    uint64_t prevFrameTime;     // ns
+    uint64_t nextFrameTime;     // ns, the deadline of the current frame
+    uint64_t elapsedFrameTime;  // ns, real duration of the last frame
+    uint64_t framePeriod;       // ns
     uint64_t frameCount;
-    uint64_t maxDeltaTime;
+    uint64_t maxDeltaTime;      // ns
+    bool synthetic;
+    uint64_t syntheticTime;     // ns
+    bool syntheticPacing;       // The synthetic time is also waited for
+
+    uint64_t stepPeriod;        // ns, 0 if the step is variable
+    int maxStepsPerFrame;
+    int stepCount;              // Steps done in the current frame
+    bool stepPending;           // Variable step only
+    uint64_t accumulator;       // ns, fixed step only: the real time not simulated yet
+    uint64_t stepTime;          // ns, of the current substep, see FrameControl_SetSubstep()
+    uint64_t stepTimeMs;        // ms
+    uint64_t stepStart;         // ns, the game time at the step start
+    uint64_t stepLength;        // ns, of the whole step
+    uint64_t gameTime;          // ns, the simulated time
+
+    bool vsync;
+    int64_t lateness;           // ns, how late the last frame started relatively to its deadline
+    int64_t maxLateness;        // ns
+    int64_t totalLateness;      // ns
+    uint64_t lateFrameCount;    // Frames started more than 1 ms late
+
+    uint64_t history[FRAME_HISTORY]; // ns, the last frame times, circular
+    uint64_t histogram[FRAME_HISTOGRAM_SIZE];
+    uint64_t clampedFrameCount;
+    uint64_t longestFrameTime;  // ns
 } fc = {0};
 
+// Returns the real time since the init in ns
+static uint64_t FrameControl_RealNow()
+{
+    // Split to avoid the overflow of counter * NS_PER_SECOND
+    const uint64_t counter = SDL_GetPerformanceCounter() - fc.startCounter;
+    return (counter / fc.counterFrequency) * NS_PER_SECOND
+        + (counter % fc.counterFrequency) * NS_PER_SECOND / fc.counterFrequency;
+}
+
+// Returns the current time in ns
+static uint64_t FrameControl_Now()
+{
+    return fc.synthetic ? fc.syntheticTime : FrameControl_RealNow();
+}
+
 // If fps <= 0, new frame will be ready right after the previous one is handled,
 // i.e. there will be no fps limit.
-// 
+//
 // The maxDeltaTime is the maximum time increment which can be correctly handled,
 // in ms. If it's <= 0, there will be no increment limit.
 //
@@ -35,49 +92,416 @@ static struct {
 // in getElapsedFrameTime(), so that each long frame will be treated as a shorter
 // one (the game will slow down at these moments). For more information, see
 // https://gafferongames.com/post/fix_your_timestep/
+//
+// The first way is available with FrameControl_SetFixedStep().
 void FrameControl_Init(uint8_t fps, uint64_t maxDeltaTime)
 {
-    fc.startTime = SDL_GetTicks64();
+    fc.synthetic = false;
+    fc.syntheticPacing = false;
+    fc.startCounter = SDL_GetPerformanceCounter();
+    fc.counterFrequency = SDL_GetPerformanceFrequency();
+    fc.startTime = FrameControl_Now();
     fc.prevFrameTime = fc.startTime;
     fc.elapsedFrameTime = 0;
-    fc.framePeriod = 1000 / fps;
+    fc.framePeriod = fps > 0 ? NS_PER_SECOND / fps : 0;
+    fc.nextFrameTime = fc.startTime + fc.framePeriod;
     fc.frameCount = 0;
-    fc.maxDeltaTime = maxDeltaTime;
+    fc.maxDeltaTime = maxDeltaTime * NS_PER_MS;
+    fc.stepCount = 0;
+    fc.stepPending = true;
+    fc.accumulator = 0;
+    fc.stepTime = 0;
+    fc.stepTimeMs = 0;
+    fc.stepStart = 0;
+    fc.stepLength = 0;
+    fc.gameTime = 0;
+    fc.vsync = false;
+    fc.lateness = 0;
+    fc.maxLateness = 0;
+    fc.totalLateness = 0;
+    fc.lateFrameCount = 0;
+    fc.clampedFrameCount = 0;
+    fc.longestFrameTime = 0;
+
+    for (int i = 0; i < FRAME_HISTOGRAM_SIZE; i++)
+    {
+        fc.histogram[i] = 0;
+    }
+}
+
+// Same as FrameControl_Init(), but the time is not real: it starts from 0 and
+// each FrameControl_WaitForNextFrame() advances it by exactly one frame period
+// without sleeping. So the game runs as fast as possible, but behaves as if it
+// runs at the given fps.
+void FrameControl_InitSynthetic(uint8_t fps, uint64_t maxDeltaTime)
+{
+    FrameControl_Init(fps, maxDeltaTime);
+    fc.synthetic = true;
+    fc.syntheticTime = 0;
+    fc.startTime = 0;
+    fc.prevFrameTime = 0;
+    fc.nextFrameTime = fc.framePeriod;
+}
+
+// In the synthetic mode, makes the current frame last frameTime ns instead of
+// the frame period (e.g. as it lasted in a recorded session)
+void FrameControl_SetFrameTime(uint64_t frameTime)
+{
+    fc.nextFrameTime = fc.prevFrameTime + frameTime;
+}
+
+// In the synthetic mode, the frames are not shorter in real time than in the
+// synthetic time, so a replay can be watched at its original speed
+void FrameControl_SetSyntheticPacing(bool pacing)
+{
+    fc.syntheticPacing = pacing;
+}
+
+// Switches to the fixed step mode: the real time of each frame is accumulated
+// and simulated by steps of exactly 1 / ticksPerSecond seconds, so the logic
+// rate does not depend on the frame rate. If the step is longer than
+// maxDeltaTime, it is reduced to maxDeltaTime (i.e. the tick rate increases).
+// At most maxStepsPerFrame steps are done per frame, the rest of the time is
+// dropped (otherwise slow steps could make each next frame even longer).
+//
+// If ticksPerSecond is 0, the step is variable: one step per frame, which
+// takes the frame time truncated to maxDeltaTime.
+void FrameControl_SetFixedStep(unsigned ticksPerSecond, int maxStepsPerFrame)
+{
+    fc.stepPeriod = ticksPerSecond > 0 ? NS_PER_SECOND / ticksPerSecond : 0;
+    fc.maxStepsPerFrame = maxStepsPerFrame > 0 ? maxStepsPerFrame : 1;
+
+    if (fc.maxDeltaTime > 0 && fc.stepPeriod > fc.maxDeltaTime)
+    {
+        fc.stepPeriod = fc.maxDeltaTime;
+    }
+}
+
+// If vsync is on, the frames are paced by SDL_RenderPresent(), which waits for
+// the display refresh, so FrameControl_WaitForNextFrame() does not sleep.
+void FrameControl_SetVsync(bool vsync)
+{
+    fc.vsync = vsync;
 }
 
 void FrameControl_Deinit()
 {
 }
 
+// Sleeps until the time is close to the deadline, then spins until the deadline
+static void FrameControl_SleepUntil(uint64_t deadline)
+{
+    const uint64_t currentTime = FrameControl_RealNow();
+
+    if (currentTime + SPIN_TIME < deadline)
+    {
+        const uint64_t sleepTime = deadline - SPIN_TIME - currentTime;
+
+#if defined(__unix__) && defined(CLOCK_MONOTONIC)
+        // The absolute deadline is not shifted if the sleep is interrupted
+        struct timespec wakeTime;
+        clock_gettime(CLOCK_MONOTONIC, &wakeTime);
+
+        const uint64_t ns = wakeTime.tv_nsec + sleepTime;
+        wakeTime.tv_sec += ns / NS_PER_SECOND;
+        wakeTime.tv_nsec = ns % NS_PER_SECOND;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeTime, NULL) == EINTR)
+        {
+        }
+#else
+        SDL_Delay(sleepTime / NS_PER_MS);
+#endif
+    }
+
+    while (FrameControl_RealNow() < deadline)
+    {
+#ifdef __SSE2__
+        _mm_pause();
+#endif
+    }
+}
+
+static void FrameControl_RecordLateness(int64_t lateness)
+{
+    fc.lateness = lateness;
+    fc.totalLateness += lateness;
+
+    if (lateness > fc.maxLateness)
+    {
+        fc.maxLateness = lateness;
+    }
+
+    if (lateness > NS_PER_MS)
+    {
+        fc.lateFrameCount += 1;
+    }
+}
+
+static void FrameControl_RecordFrameTime(uint64_t frameTime)
+{
+    fc.history[fc.frameCount % FRAME_HISTORY] = frameTime;
+
+    const uint64_t bucket = frameTime / (FRAME_HISTOGRAM_BUCKET * NS_PER_MS);
+    fc.histogram[bucket < FRAME_HISTOGRAM_SIZE ? bucket : FRAME_HISTOGRAM_SIZE - 1] += 1;
+
+    if (frameTime > fc.longestFrameTime)
+    {
+        fc.longestFrameTime = frameTime;
+    }
+}
+
 void FrameControl_WaitForNextFrame()
 {
-    const uint64_t nextFrameTime = fc.prevFrameTime + fc.framePeriod;
-    uint64_t currentTime = SDL_GetTicks64();
+    const uint64_t nextFrameTime = fc.nextFrameTime;
+
+    if (fc.synthetic)
+    {
+        fc.syntheticTime = nextFrameTime;
 
-    while (currentTime < nextFrameTime)
+        if (fc.syntheticPacing)
+        {
+            FrameControl_SleepUntil(nextFrameTime);
+        }
+    }
+    else if (!fc.vsync && fc.framePeriod > 0)
     {
-        SDL_Delay(1);
-        currentTime = SDL_GetTicks64();
+        FrameControl_SleepUntil(nextFrameTime);
+    }
+
+    const uint64_t currentTime = FrameControl_Now();
+
+    if (fc.framePeriod > 0)
+    {
+        FrameControl_RecordLateness((int64_t)(currentTime - nextFrameTime));
+    }
+
+    // The deadlines follow the fixed schedule, so the lateness of one frame
+    // does not shift the next ones. But if the frame is later than a whole
+    // period, there is no point to catch up, the schedule starts anew.
+    fc.nextFrameTime += fc.framePeriod;
+    if (fc.nextFrameTime <= currentTime)
+    {
+        fc.nextFrameTime = currentTime + fc.framePeriod;
     }
 
     fc.elapsedFrameTime = currentTime - fc.prevFrameTime;
     fc.prevFrameTime = currentTime;
+    FrameControl_RecordFrameTime(fc.elapsedFrameTime);
     fc.frameCount += 1;
+
+    fc.stepCount = 0;
+    fc.stepPending = true;
+
+    if (fc.stepPeriod > 0)
+    {
+        fc.accumulator += fc.elapsedFrameTime;
+    }
+}
+
+static void FrameControl_BeginStep(uint64_t stepTime)
+{
+    // The step is also counted in whole ms for the integer timers. The ms are
+    // taken from the total game time, so they sum up exactly and the rounding
+    // error does not accumulate (e.g. steps of 20.83 ms give 20, 21, 21, 21...).
+    fc.stepTime = stepTime;
+    fc.stepTimeMs = (fc.gameTime + stepTime) / NS_PER_MS - fc.gameTime / NS_PER_MS;
+    fc.stepStart = fc.gameTime;
+    fc.stepLength = stepTime;
+    fc.gameTime += stepTime;
+    fc.stepCount += 1;
+}
+
+// The parts are taken from the game time too, so they sum up to the step
+// exactly, in ns and in whole ms
+void FrameControl_SetSubstep(int index, int count)
+{
+    const uint64_t begin = fc.stepStart + fc.stepLength * index / count;
+    const uint64_t end = fc.stepStart + fc.stepLength * (index + 1) / count;
+    fc.stepTime = end - begin;
+    fc.stepTimeMs = end / NS_PER_MS - begin / NS_PER_MS;
+}
+
+// Returns true if there is one more logic step to do in this frame. Usage:
+// while (FrameControl_NextStep()) { process the game logic }
+bool FrameControl_NextStep()
+{
+    // Variable step
+    if (fc.stepPeriod == 0)
+    {
+        if (!fc.stepPending)
+        {
+            return false;
+        }
+
+        fc.stepPending = false;
+
+        if ((fc.maxDeltaTime > 0) && (fc.elapsedFrameTime > fc.maxDeltaTime))
+        {
+            fc.clampedFrameCount += 1;
+        }
+
+        FrameControl_BeginStep(
+            ((fc.maxDeltaTime > 0) && (fc.elapsedFrameTime > fc.maxDeltaTime))
+            ? fc.maxDeltaTime
+            : fc.elapsedFrameTime
+        );
+        return true;
+    }
+
+    // Fixed step
+    if (fc.accumulator < fc.stepPeriod)
+    {
+        return false;
+    }
+
+    if (fc.stepCount >= fc.maxStepsPerFrame)
+    {
+        fc.clampedFrameCount += 1;
+        fc.accumulator %= fc.stepPeriod;
+        return false;
+    }
+
+    fc.accumulator -= fc.stepPeriod;
+    FrameControl_BeginStep(fc.stepPeriod);
+    return true;
+}
+
+double FrameControl_GetAlpha()
+{
+    return fc.stepPeriod > 0
+        ? (double)fc.accumulator / fc.stepPeriod
+        : 1.0;
+}
+
+uint64_t FrameControl_GetFrameTime()
+{
+    return fc.elapsedFrameTime;
 }
 
 uint64_t FrameControl_GetElapsedFrameTime()
 {
-    return ((fc.maxDeltaTime > 0) && (fc.elapsedFrameTime > fc.maxDeltaTime))
-        ? fc.maxDeltaTime
-        : fc.elapsedFrameTime;
+    return fc.stepTimeMs;
+}
+
+Scalar FrameControl_GetDeltaTime()
+{
+#ifdef PLATFORMER_FIXED_POINT
+    // Exactly from the integer time, not through a double
+    return (Scalar)((fc.stepTime * SCALAR_ONE) / NS_PER_SECOND);
+#else
+    return (double)fc.stepTime / NS_PER_SECOND;
+#endif
 }
 
 uint64_t FrameControl_GetElapsedTime()
 {
-    return SDL_GetTicks64() - fc.startTime;
+    return (FrameControl_Now() - fc.startTime) / NS_PER_MS;
 }
 
 double FrameControl_GetCurrentFps()
 {
-    return fc.frameCount / ((fc.prevFrameTime - fc.startTime) / 1000.0);
+    return fc.frameCount / ((double)(fc.prevFrameTime - fc.startTime) / NS_PER_SECOND);
+}
+
+int64_t FrameControl_GetFrameLateness()
+{
+    return fc.lateness;
+}
+
+static int FrameControl_Compare(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Returns the value below which the given fraction of the sorted times are
+static double FrameControl_Percentile(const uint64_t* sorted, int count, double fraction)
+{
+    int i = (int)ceil(fraction * count) - 1;
+    i = i < 0 ? 0 : (i >= count ? count - 1 : i);
+    return (double)sorted[i] / NS_PER_MS;
+}
+
+// The window statistics are calculated over the last FRAME_HISTORY frames,
+// the histogram, the longest frame and the clamped count - over all frames.
+// A frame is clamped if a part of its time was not simulated: it was longer
+// than maxDeltaTime, or had more than maxStepsPerFrame fixed steps.
+void FrameControl_GetStats(FrameStats* stats)
+{
+    static uint64_t sorted[FRAME_HISTORY];
+    const int count = fc.frameCount < FRAME_HISTORY ? fc.frameCount : FRAME_HISTORY;
+
+    *stats = (FrameStats) {0};
+    stats->frameCount = fc.frameCount;
+    stats->windowFrameCount = count;
+    stats->longest = (double)fc.longestFrameTime / NS_PER_MS;
+    stats->clampedFrameCount = fc.clampedFrameCount;
+
+    for (int i = 0; i < FRAME_HISTOGRAM_SIZE; i++)
+    {
+        stats->histogram[i] = fc.histogram[i];
+    }
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        sorted[i] = fc.history[i];
+        total += fc.history[i];
+    }
+    qsort(sorted, count, sizeof(sorted[0]), FrameControl_Compare);
+
+    stats->min = (double)sorted[0] / NS_PER_MS;
+    stats->max = (double)sorted[count - 1] / NS_PER_MS;
+    stats->mean = (double)total / count / NS_PER_MS;
+    stats->p50 = FrameControl_Percentile(sorted, count, 0.5);
+    stats->p95 = FrameControl_Percentile(sorted, count, 0.95);
+    stats->p99 = FrameControl_Percentile(sorted, count, 0.99);
+    stats->p999 = FrameControl_Percentile(sorted, count, 0.999);
+}
+
+void FrameControl_PrintReport(FILE* file)
+{
+    const uint64_t frameCount = fc.frameCount > 0 ? fc.frameCount : 1;
+    FrameStats stats;
+    FrameControl_GetStats(&stats);
+
+    fprintf(file, "frames=%llu, fps=%.2f\n",
+        (unsigned long long)fc.frameCount, FrameControl_GetCurrentFps());
+    fprintf(file, "lateness: mean=%.3f ms, max=%.3f ms, late frames (> 1 ms)=%llu\n",
+        (double)fc.totalLateness / frameCount / NS_PER_MS,
+        (double)fc.maxLateness / NS_PER_MS,
+        (unsigned long long)fc.lateFrameCount);
+    fprintf(file, "frame time (last %d frames): min=%.3f, mean=%.3f, max=%.3f, "
+        "p50=%.3f, p95=%.3f, p99=%.3f, p99.9=%.3f ms\n",
+        stats.windowFrameCount, stats.min, stats.mean, stats.max,
+        stats.p50, stats.p95, stats.p99, stats.p999);
+    fprintf(file, "longest frame=%.3f ms, clamped frames=%llu\n",
+        stats.longest, (unsigned long long)stats.clampedFrameCount);
+    fprintf(file, "histogram:\n");
+
+    for (int i = 0; i < FRAME_HISTOGRAM_SIZE; i++)
+    {
+        if (stats.histogram[i] == 0)
+        {
+            continue;
+        }
+
+        if (i < FRAME_HISTOGRAM_SIZE - 1)
+        {
+            fprintf(file, "  %3d - %3d ms: %llu\n", i * FRAME_HISTOGRAM_BUCKET,
+                (i + 1) * FRAME_HISTOGRAM_BUCKET, (unsigned long long)stats.histogram[i]);
+        }
+        else
+        {
+            fprintf(file, "  %3d+      ms: %llu\n", i * FRAME_HISTOGRAM_BUCKET,
+                (unsigned long long)stats.histogram[i]);
+        }
+    }
 }
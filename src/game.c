@@ -9,8 +9,15 @@
 #include "helpers.h"
 #include "render.h"
 #include "levels.h"
+#include "broadphase.h"
+#include "hitbatch.h"
+#include "replay.h"
+#include "trace.h"
+#include "jobs.h"
 #include <SDL2/SDL_ttf.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 typedef enum {
@@ -24,25 +31,51 @@ typedef enum {
 static struct {
     GAME_STATE state;
     const Uint8* keystate;
-    struct { double x, y; } respawnPos;
-    uint64_t cleanTime;
+    uint8_t keys;           // GameKey mask of the current frame
+    struct { Scalar x, y; } respawnPos;
     bool jumpDenied;
+    bool headless;
+    uint64_t frameLimit;
+    uint64_t frameCount;
+    unsigned tickRate;
+    bool frameReport;
+    const char* tracePath;
+    HitBatch hitBatch;
+
+    // Object update, see Game_ProcessObjects()
+    int updateBegin;
+    int updateEnd;
+    uint32_t updateSeed;
+    struct SpawnBuffer_s* spawnBuffers; // Per chunk
+    int spawnBufferCount;
 } game;
 
+// Objects are updated by chunks, and each chunk collects its spawned objects
+// separately, so the result does not depend on the thread count
+enum { OBJECT_CHUNK_SIZE = 64 };
+
+typedef struct SpawnBuffer_s {
+    Object* objects;
+    int count;
+    int reserved;
+} SpawnBuffer;
+
+static _Thread_local SpawnBuffer* spawnBuffer = NULL;   // Set during the object update
+
 Level* level = NULL;
 Player player;
 
-static const double PLAYER_SPEED_RUN = 72;          // Pixels per second 
-static const double PLAYER_SPEED_LADDER = 48;       //
-static const double PLAYER_SPEED_JUMP = 216;        //
-static const double PLAYER_SPEED_FALL_MAX = 120;    //
+static const Scalar PLAYER_SPEED_RUN = SCALAR(72);          // Pixels per second 
+static const Scalar PLAYER_SPEED_LADDER = SCALAR(48);       //
+static const Scalar PLAYER_SPEED_JUMP = SCALAR(216);        //
+static const Scalar PLAYER_SPEED_FALL_MAX = SCALAR(120);    //
 
-static const double PLAYER_GRAVITY = 24 * 48;       // Pixels per second per second
+static const Scalar PLAYER_GRAVITY = SCALAR(24 * 48);       // Pixels per second per second
 
 static const double PLAYER_ANIM_SPEED_RUN = 8;      // Frames per second
 static const double PLAYER_ANIM_SPEED_LADDER = 6;   //
 
-static const double CLEAN_PERIOD = 10000;           // Milliseconds
+static const int MAX_STEPS_PER_FRAME = 8;
 
 
 void Game_DamagePlayer(int damage)
@@ -93,12 +126,21 @@ void Game_RespawnPlayer()
 
 void Game_SetLevel(int r, int c)
 {
-    level = &levels[r][c];
+    level = Levels_Get(r, c);
+    level->played = true;
 
     if (level->init)
     {
         level->init();
     }
+
+    // The init may change the sprites
+    Types_InvalidateTiles(level);
+
+    Broadphase_Invalidate(level);
+
+    // So that the next level is ready when the player reaches it
+    Levels_Prefetch(r, c);
 }
 
 void Game_CompleteLevel()
@@ -106,10 +148,63 @@ void Game_CompleteLevel()
     game.state = STATE_LEVELCOMPLETE;
 }
 
+Object* Game_SpawnObject(ObjectTypeId typeId)
+{
+    if (!spawnBuffer)
+    {
+        return Types_CreateObject(level, typeId, 0, 0);
+    }
+
+    if (spawnBuffer->count == spawnBuffer->reserved)
+    {
+        spawnBuffer->reserved = spawnBuffer->reserved ? spawnBuffer->reserved * 2 : 8;
+        spawnBuffer->objects = (Object*)realloc(spawnBuffer->objects, spawnBuffer->reserved * sizeof(Object));
+        Util_EnsureSDL(spawnBuffer->objects != NULL, "Could not spawn an object.");
+    }
+
+    Object* object = &spawnBuffer->objects[spawnBuffer->count];
+    spawnBuffer->count += 1;
+    Types_InitObject(object, typeId);
+    return object;
+}
+
+// Takes the keys of the frame from the keyboard, or from the replay
+static void Game_ReadKeys(bool quitRequested)
+{
+    if (Replay_IsPlaying())
+    {
+        uint64_t frameTime;
+
+        if (!Replay_PlayFrame(&game.keys, &frameTime))
+        {
+            game.keys = GAME_KEY_QUIT;
+            return;
+        }
+
+        FrameControl_SetFrameTime(frameTime);
+
+        // The window can be closed during the playback too
+        if (quitRequested)
+        {
+            game.keys |= GAME_KEY_QUIT;
+        }
+        return;
+    }
+
+    game.keys =
+        (game.keystate[SDL_SCANCODE_LEFT] ? GAME_KEY_LEFT : 0) |
+        (game.keystate[SDL_SCANCODE_RIGHT] ? GAME_KEY_RIGHT : 0) |
+        (game.keystate[SDL_SCANCODE_UP] ? GAME_KEY_UP : 0) |
+        (game.keystate[SDL_SCANCODE_DOWN] ? GAME_KEY_DOWN : 0) |
+        (game.keystate[SDL_SCANCODE_SPACE] ? GAME_KEY_SPACE : 0) |
+        (game.keystate[SDL_SCANCODE_F] ? GAME_KEY_F : 0) |
+        (quitRequested ? GAME_KEY_QUIT : 0);
+}
+
 static void Game_ProcessInput()
 {
     // ... Left
-    if (game.keystate[SDL_SCANCODE_LEFT])
+    if (game.keys & GAME_KEY_LEFT)
     {
         if (!player.onLadder)
         {
@@ -126,7 +221,7 @@ static void Game_ProcessInput()
         player.vx = -PLAYER_SPEED_RUN;
     }
     // ... Right
-    else if (game.keystate[SDL_SCANCODE_RIGHT])
+    else if (game.keys & GAME_KEY_RIGHT)
     {
         if (!player.onLadder)
         {
@@ -153,7 +248,7 @@ static void Game_ProcessInput()
     }
 
     // ... Up
-    if (game.keystate[SDL_SCANCODE_UP])
+    if (game.keys & GAME_KEY_UP)
     {
         int r, c;
         Util_GetObjectCell((Object*)&player, &r, &c);
@@ -170,13 +265,13 @@ static void Game_ProcessInput()
         {
             player.onLadder = true;
             player.vy = -PLAYER_SPEED_LADDER;
-            player.x = c * CELL_SIZE;
+            player.x = Scalar_FromInt(c * CELL_SIZE);
             Render_SetAnimationFlip((Object*)&player, 3, PLAYER_ANIM_SPEED_LADDER);
             game.jumpDenied = true;
         }
     }
     // ... Down
-    else if (game.keystate[SDL_SCANCODE_DOWN])
+    else if (game.keys & GAME_KEY_DOWN)
     {
         int r, c;
         Util_GetObjectCell((Object*)&player, &r, &c);
@@ -185,10 +280,10 @@ static void Game_ProcessInput()
             if (!player.onLadder)
             {
                 player.onLadder = true;
-                player.y = r * CELL_SIZE + CELL_HALF + 1;
+                player.y = Scalar_FromInt(r * CELL_SIZE + CELL_HALF + 1);
             }
             player.vy = PLAYER_SPEED_LADDER;
-            player.x = c * CELL_SIZE;
+            player.x = Scalar_FromInt(c * CELL_SIZE);
             Render_SetAnimationFlip((Object*)&player, 3, PLAYER_ANIM_SPEED_LADDER);
         }
     }
@@ -207,7 +302,7 @@ static void Game_ProcessInput()
     }
 
     // ... Space
-    if (game.keystate[SDL_SCANCODE_SPACE])
+    if (game.keys & GAME_KEY_SPACE)
     {
         int r, c;
 
@@ -218,73 +313,131 @@ static void Game_ProcessInput()
             if (player.keys > 0)
             {
                 player.keys -= 1;
-                level->cells[r][c] = &objectTypes[TYPE_NONE];
+                Types_CreateStaticObject(level, TYPE_NONE, r, c);
             }
         }
     }
 
 #ifdef DEBUG_MODE
     // ... F, simulate "frame by frame" mode
-    if (game.keystate[SDL_SCANCODE_F])
+    if (game.keys & GAME_KEY_F)
     {
         SDL_Delay(1000);
     }
 #endif // DEBUG_MODE
 }
 
+// Context of the player sweeps, see Game_PlayerSweepTest()
+typedef struct {
+    int c;          // Column of the player center
+    bool onLadder;
+} PlayerSweep;
+
+static bool Game_PlayerSweepTest(void* context, int r, int c, int side)
+{
+    const PlayerSweep* sweep = context;
+
+    // A ladder holds the player from above, if the player is not climbing it
+    return Util_IsSolid(r, c, side)
+        || (side == SOLID_TOP && c == sweep->c && !sweep->onLadder && Util_isSolidLadder(r, c));
+}
+
+// Returns the cells a player sprite covers from start to end, hit is how
+// much it may overlap the cells before they count
+static void Game_GetPlayerLanes(double start, double end, double hit, int cell, int* first, int* last)
+{
+    const double cellStart = CELL_SIZE * cell;
+    *first = start + hit < cellStart ? cell - 1 : cell;
+    *last = end - hit > cellStart + CELL_SIZE ? cell + 1 : cell;
+}
+
+static Borders Game_GetPlayerSprite()
+{
+    const double x = Scalar_ToDouble(player.x);
+    const double y = Scalar_ToDouble(player.y);
+    return (Borders){x, x + CELL_SIZE, y, y + CELL_SIZE};
+}
+
+// Returns the SolidFlags and CellFlags of a cell of another level, 0 outside it
+static int Game_GetCellFlags(const Level* other, int r, int c)
+{
+    if ((unsigned)r >= (unsigned)other->rowCount || (unsigned)c >= (unsigned)other->columnCount)
+    {
+        return 0;
+    }
+    return other->cellFlags[Level_GetCell(other, r, c)];
+}
+
 static void Game_ProcessPlayer()
 {
     // Movement
-    const double dt = FrameControl_GetElapsedFrameTime() / 1000.0;
+    const Scalar dt = FrameControl_GetDeltaTime();
     const double hitw = (CELL_SIZE - player.type->body.w) / 2.0;
     const double hith = hitw;
 
     int r, c; Borders cell, body;
     Util_GetObjectPos((Object*)&player, &r, &c, &cell, &body);
 
-    player.vx = Util_LimitAbs(player.vx, MAX_SPEED);
-    player.vy = Util_LimitAbs(player.vy, MAX_SPEED);
+    PlayerSweep context = {c, player.onLadder};
+    Sweep sweep;
+    SweepHit hit;
 
-    // ... X
-    player.x += player.vx * dt;
-    Borders sprite = {player.x, player.x + CELL_SIZE, player.y, player.y + CELL_SIZE};
+    // ... X, the sprite is swept through the cells
+    const Borders startX = Game_GetPlayerSprite();
+    player.x += Scalar_Mul(player.vx, dt);
+    Borders sprite = Game_GetPlayerSprite();
+
+    sweep.cell = c;
+    Game_GetPlayerLanes(sprite.top, sprite.bottom, hith, r, &sweep.laneFirst, &sweep.laneLast);
 
     // ... Left
     if (sprite.left < cell.left && player.vx <= 0)
     {
-        if (Util_IsSolid(r, c - 1, SOLID_RIGHT)
-        || (sprite.top + hith < cell.top && Util_IsSolid(r - 1, c - 1, SOLID_RIGHT))
-        || (sprite.bottom - hith > cell.bottom && Util_IsSolid(r + 1, c - 1, SOLID_RIGHT)))
+        sweep.side = SOLID_RIGHT;
+        sweep.edge = startX.left;
+        sweep.end = sprite.left;
+
+        if (Util_Sweep(&sweep, Game_PlayerSweepTest, &context, &hit))
         {
-            player.x = cell.left;
+            player.x = Scalar_FromDouble(hit.edge);
             player.vx = 0;
         }
     // ... Right
     }
     else if (sprite.right > cell.right && player.vx >= 0)
     {
-        if (Util_IsSolid(r, c + 1, SOLID_LEFT)
-        || (sprite.top + hith < cell.top && Util_IsSolid(r - 1, c + 1, SOLID_LEFT))
-        || (sprite.bottom - hith > cell.bottom && Util_IsSolid(r + 1, c + 1, SOLID_LEFT)))
+        sweep.side = SOLID_LEFT;
+        sweep.edge = startX.right;
+        sweep.end = sprite.right;
+
+        if (Util_Sweep(&sweep, Game_PlayerSweepTest, &context, &hit))
         {
-            player.x = cell.left;
+            player.x = Scalar_FromDouble(hit.edge - CELL_SIZE);
             player.vx = 0;
         }
     }
 
-    // ... Y
-    player.y += player.vy * dt;
-    sprite = (Borders){player.x, player.x + CELL_SIZE, player.y, player.y + CELL_SIZE};
+    // ... Y, from the cell where X movement has brought the player
+    Util_GetObjectPos((Object*)&player, &r, &c, &cell, &body);
+    context.c = c;
+
+    const Borders startY = Game_GetPlayerSprite();
+    player.y += Scalar_Mul(player.vy, dt);
+    sprite = Game_GetPlayerSprite();
+
+    sweep.cell = r;
+    Game_GetPlayerLanes(sprite.left, sprite.right, hitw, c, &sweep.laneFirst, &sweep.laneLast);
 
     // ... Bottom
     if (sprite.bottom > cell.bottom && player.vy >= 0)
     {
-        if (Util_IsSolid(r + 1, c, SOLID_TOP)
-        || (sprite.left + hitw < cell.left && Util_IsSolid(r + 1, c - 1, SOLID_TOP))
-        || (sprite.right - hitw > cell.right && Util_IsSolid(r + 1, c + 1, SOLID_TOP))
-        || (!player.onLadder && Util_isSolidLadder(r + 1, c)))
+        sweep.side = SOLID_TOP;
+        sweep.edge = startY.bottom;
+        sweep.end = sprite.bottom;
+
+        if (Util_Sweep(&sweep, Game_PlayerSweepTest, &context, &hit))
         {
-            player.y = cell.top;
+            player.y = Scalar_FromDouble(hit.edge - CELL_SIZE);
             player.vy = 0;
             player.inAir = false;
 
@@ -302,31 +455,36 @@ static void Game_ProcessPlayer()
     }
     else if (sprite.top < cell.top && player.vy <= 0)
     {
-        if (Util_IsSolid(r - 1, c, SOLID_BOTTOM)
-        || (sprite.left + hitw < cell.left && Util_IsSolid(r - 1, c - 1, SOLID_BOTTOM))
-        || (sprite.right - hitw > cell.right && Util_IsSolid(r - 1, c + 1, SOLID_BOTTOM)))
+        sweep.side = SOLID_BOTTOM;
+        sweep.edge = startY.top;
+        sweep.end = sprite.top;
+
+        if (Util_Sweep(&sweep, Game_PlayerSweepTest, &context, &hit))
         {
-            player.y = cell.top;
-            player.vy += 1;
+            player.y = Scalar_FromDouble(hit.edge);
+            player.vy += SCALAR(1);
         }
         player.inAir = !player.onLadder;
     }
 
-    // Screen borders
+    // Level borders, the levels of a world are of the same size
     Util_GetObjectCell((Object*)&player, &r, &c);
 
     const int lc = level->c;
     const int lr = level->r;
+    const int width = Level_GetWidth(level);
+    const int height = Level_GetHeight(level);
 
     // ... Left
     if (player.x < 0)
     {
-        if (lc > 0 && !levels[lr][lc - 1].cells[r][COLUMN_COUNT - 1]->solid)
+        const Level* left = Levels_Get(lr, lc - 1);
+        if (left && !(Game_GetCellFlags(left, r, left->columnCount - 1) & SOLID_ALL))
         {
-            if (player.x + CELL_HALF < 0)
+            if (player.x + SCALAR(CELL_HALF) < 0)
             {
                 Game_SetLevel(lr, lc - 1);
-                player.x = LEVEL_WIDTH - CELL_HALF - 1;
+                player.x = Scalar_FromInt(width - CELL_HALF - 1);
             }
         }
         else
@@ -335,37 +493,39 @@ static void Game_ProcessPlayer()
         }
     // ... Right
     }
-    else if (player.x + CELL_SIZE > LEVEL_WIDTH)
+    else if (player.x + SCALAR(CELL_SIZE) > Scalar_FromInt(width))
     {
-        if (lc < LEVEL_COUNTX - 1 && !levels[lr][lc + 1].cells[r][0]->solid)
+        const Level* right = Levels_Get(lr, lc + 1);
+        if (right && !(Game_GetCellFlags(right, r, 0) & SOLID_ALL))
         {
-            if (player.x + CELL_HALF > LEVEL_WIDTH)
+            if (player.x + SCALAR(CELL_HALF) > Scalar_FromInt(width))
             {
                 Game_SetLevel(lr, lc + 1);
-                player.x = -CELL_HALF + 1;
+                player.x = SCALAR(-CELL_HALF + 1);
             }
         }
         else
         {
-            player.x = LEVEL_WIDTH - CELL_SIZE;
+            player.x = Scalar_FromInt(width - CELL_SIZE);
         }
     }
     // ... Bottom
-    if (player.y + player.type->body.h > LEVEL_HEIGHT)
+    if (player.y + Scalar_FromInt(player.type->body.h) > Scalar_FromInt(height))
     {
-        if (lr < LEVEL_COUNTY - 1)
+        const Level* bottom = Levels_Get(lr + 1, lc);
+        if (bottom)
         {
-            if (!levels[lr + 1][lc].cells[0][c]->solid)
+            if (!(Game_GetCellFlags(bottom, 0, c) & SOLID_ALL))
             {
-                if (player.y + player.type->body.h / 2.0 > LEVEL_HEIGHT)
+                if (player.y + Scalar_FromDouble(player.type->body.h / 2.0) > Scalar_FromInt(height))
                 {
                     Game_SetLevel(lr + 1, lc);
-                    player.y = -CELL_HALF + 1;
+                    player.y = SCALAR(-CELL_HALF + 1);
                 }
             }
             else
             {
-                player.y = LEVEL_HEIGHT - player.type->body.h;
+                player.y = Scalar_FromInt(height - player.type->body.h);
                 player.inAir = false;
             }
         }
@@ -377,12 +537,13 @@ static void Game_ProcessPlayer()
     // ... Top
     else if (player.y < 0)
     {
-        if (lr > 0 && !levels[lr - 1][lc].cells[ROW_COUNT - 1][c]->solid)
+        const Level* top = Levels_Get(lr - 1, lc);
+        if (top && !(Game_GetCellFlags(top, top->rowCount - 1, c) & SOLID_ALL))
         {
-            if (player.y + CELL_HALF < 0)
+            if (player.y + SCALAR(CELL_HALF) < 0)
             {
                 Game_SetLevel(lr - 1, lc);
-                player.y = LEVEL_HEIGHT - CELL_HALF - 1;
+                player.y = Scalar_FromInt(height - CELL_HALF - 1);
             }
         }
         else if (lr > 0)
@@ -401,7 +562,7 @@ static void Game_ProcessPlayer()
     // ... Gravity
     if (!player.onLadder)
     {
-        player.vy += PLAYER_GRAVITY * dt;
+        player.vy += Scalar_Mul(PLAYER_GRAVITY, dt);
         if (player.vy > PLAYER_SPEED_FALL_MAX)
         {
             player.vy = PLAYER_SPEED_FALL_MAX;
@@ -416,7 +577,7 @@ static void Game_ProcessPlayer()
         if (player.vy < 0)
         {
             player.vy = 0;
-            player.y = CELL_SIZE * r;
+            player.y = Scalar_FromInt(CELL_SIZE * r);
         }
     }
 
@@ -429,7 +590,7 @@ static void Game_ProcessPlayer()
     // ... Invincibility
     if (player.invincibility > 0)
     {
-        player.invincibility -= dt * 1000;
+        player.invincibility -= Scalar_ToDouble(dt) * 1000;
         if (player.invincibility < 0)
         {
             player.invincibility = 0;
@@ -445,80 +606,210 @@ static void Game_ProcessPlayer()
     }
 }
 
-static void Game_ProcessObjects()
+// Updates a chunk of the objects. An object changes only itself, reads the
+// level and the player, and spawns the objects through Game_SpawnObject(), so
+// the chunks can be updated in parallel.
+static void Game_UpdateChunk(void* context, int chunk)
 {
-    // for (ObjectListNode* iter = level->objects.first; iter != NULL; iter = iter->next)
-    for (ListNode* iter = level->objects.first; iter != NULL; iter = iter->next)
+    (void)context;
+
+    const int begin = game.updateBegin + chunk * OBJECT_CHUNK_SIZE;
+    const int end = begin + OBJECT_CHUNK_SIZE < game.updateEnd ? begin + OBJECT_CHUNK_SIZE : game.updateEnd;
+    spawnBuffer = &game.spawnBuffers[chunk];
+
+    for (int i = begin; i < end; i++)
     {
-        Object* object = iter->data;
+        Object* object = level->objects.array[i];
 
         if (object == (Object*)&player || object->removed)
         {
             continue;
         }
 
+        // The random numbers of an object depend only on its index
+        Util_BeginRandomStream(game.updateSeed, i);
+
+        TRACE_BEGIN_ARG("onFrame", object->type->typeId);
         object->type->onFrame(object);
+        TRACE_END();
+    }
+
+    Util_EndRandomStream();
+    spawnBuffer = NULL;
+}
+
+static void Game_ProcessObjects()
+{
+    game.updateSeed = Util_Random();
+
+    // The spawned objects are updated in the same step, after their parents
+    for (game.updateBegin = 0; game.updateBegin < level->objects.count; game.updateBegin = game.updateEnd)
+    {
+        game.updateEnd = level->objects.count;
+        const int chunkCount = (game.updateEnd - game.updateBegin + OBJECT_CHUNK_SIZE - 1) / OBJECT_CHUNK_SIZE;
 
-        if (Util_HitTest(object, (Object*)&player))
+        if (chunkCount > game.spawnBufferCount)
         {
+            game.spawnBuffers = (SpawnBuffer*)realloc(game.spawnBuffers, chunkCount * sizeof(SpawnBuffer));
+            Util_EnsureSDL(game.spawnBuffers != NULL, "Could not allocate the spawn buffers.");
+            memset(game.spawnBuffers + game.spawnBufferCount, 0, (chunkCount - game.spawnBufferCount) * sizeof(SpawnBuffer));
+            game.spawnBufferCount = chunkCount;
+        }
+
+        TRACE_BEGIN("UpdateObjects");
+        Jobs_Run(Game_UpdateChunk, NULL, chunkCount);
+        TRACE_END();
+
+        // The sync point: the spawned objects join the level in a fixed order
+        for (int chunk = 0; chunk < chunkCount; chunk++)
+        {
+            SpawnBuffer* buffer = &game.spawnBuffers[chunk];
+            for (int i = 0; i < buffer->count; i++)
+            {
+                Object* object = ObjectPool_Alloc(&level->pool);
+                *object = buffer->objects[i];
+                // Drawn from where it was spawned, not moving in from (0, 0)
+                object->prevX = object->x;
+                object->prevY = object->y;
+                ObjectArray_Append(&level->objects, object);
+            }
+            buffer->count = 0;
+        }
+    }
+
+    // Test all the moved objects against the player at once
+    TRACE_BEGIN("HitBatch");
+    HitBatch_Build(&game.hitBatch, &level->objects, (Object*)&player);
+    const int hitCount = HitBatch_Test(&game.hitBatch, (Object*)&player);
+    TRACE_END();
+
+    for (int i = 0; i < hitCount; i++)
+    {
+        Object* object = game.hitBatch.hits[i];
+
+        if (!object->removed)
+        {
+            TRACE_BEGIN_ARG("onHit", object->type->typeId);
             object->type->onHit(object);
+            TRACE_END();
         }
     }
 }
 
-static void Game_ProcessFrame()
+static void Game_DrawFrame()
 {
-    // Draw screen
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-
-    Render_DrawScreen();
+    MessageId message = MESSAGE_NONE;
 
     switch (game.state)
     {
         case STATE_KILLED:
-            Render_DrawMessage(MESSAGE_PLAYER_KILLED);
+            message = MESSAGE_PLAYER_KILLED;
             break;
 
         case STATE_LEVELCOMPLETE:
-            Render_DrawMessage(MESSAGE_LEVEL_COMPLETE);
+            message = MESSAGE_LEVEL_COMPLETE;
             break;
 
         case STATE_GAMEOVER:
-            Render_DrawMessage(MESSAGE_GAME_OVER);
+            message = MESSAGE_GAME_OVER;
             break;
 
         default:
             break;
     }
 
-    SDL_RenderPresent(renderer);
+    TRACE_BEGIN("Render_SubmitFrame");
+    Render_SubmitFrame(message);
+    TRACE_END();
+}
 
-    // Read all events
-    SDL_Event event;
+static void Game_SavePositions()
+{
+    for (int i = 0; i < level->objects.count; i++)
+    {
+        Object* object = level->objects.array[i];
+        object->prevX = object->x;
+        object->prevY = object->y;
+    }
+}
 
-    while (SDL_PollEvent(&event))
+// The cells are swept, but the player and the objects are tested against each
+// other where they are after the move, so they must not move by more than a
+// cell at once. A step where something moves faster is done in parts, each a
+// cell or less.
+enum { SUBSTEP_MAX = 64 };
+
+static inline Scalar Game_MaxSpeed(Scalar speed, const Object* object)
+{
+    speed = Scalar_Abs(object->vx) > speed ? Scalar_Abs(object->vx) : speed;
+    return Scalar_Abs(object->vy) > speed ? Scalar_Abs(object->vy) : speed;
+}
+
+static int Game_GetSubstepCount()
+{
+    const Scalar dt = FrameControl_GetDeltaTime();
+
+    // The player also falls faster during the step
+    Scalar speed = Game_MaxSpeed(0, (Object*)&player) + Scalar_Mul(PLAYER_GRAVITY, dt);
+
+    for (int i = 0; i < level->objects.count; i++)
     {
-        if (event.type == SDL_QUIT)
+        const Object* object = level->objects.array[i];
+
+        if (!object->removed)
         {
-            game.state = STATE_QUIT;
+            speed = Game_MaxSpeed(speed, object);
         }
     }
 
-    // Process user input and game logic
-    const uint64_t current_time = FrameControl_GetElapsedTime();
+    const int count = Scalar_ToInt(Scalar_Mul(speed, dt)) / CELL_SIZE + 1;
+    return count < SUBSTEP_MAX ? count : SUBSTEP_MAX;
+}
+
+static void Game_ProcessPlaying()
+{
+    const int substepCount = Game_GetSubstepCount();
+
+    for (int i = 0; i < substepCount && game.state == STATE_PLAYING; i++)
+    {
+        if (substepCount > 1)
+        {
+            FrameControl_SetSubstep(i, substepCount);
+        }
+
+        // The objects have moved, so the grid is built again on the next query
+        Broadphase_Invalidate(level);
+
+        TRACE_BEGIN("Game_ProcessInput");
+        Game_ProcessInput();
+        TRACE_END();
+
+        TRACE_BEGIN("Game_ProcessPlayer");
+        Game_ProcessPlayer();
+        TRACE_END();
+
+        TRACE_BEGIN("Game_ProcessObjects");
+        Game_ProcessObjects();
+        TRACE_END();
+    }
+}
+
+static void Game_ProcessStep()
+{
+    // Remember where the objects were, so they can be drawn between the steps
+    Game_SavePositions();
+
+    // Animations are part of the game state, so they advance in headless mode too
+    Render_AnimateObjects();
 
     switch (game.state)
     {
         case STATE_PLAYING:
-            Game_ProcessInput();
-            Game_ProcessPlayer();
-            Game_ProcessObjects();
+            Game_ProcessPlaying();
             break;
 
         case STATE_KILLED:
-            if (game.keystate[SDL_SCANCODE_SPACE])
+            if (game.keys & GAME_KEY_SPACE)
             {
                 game.state = STATE_PLAYING;
                 Game_RespawnPlayer();
@@ -526,14 +817,14 @@ static void Game_ProcessFrame()
             break;
 
         case STATE_LEVELCOMPLETE:
-            if (game.keystate[SDL_SCANCODE_SPACE])
+            if (game.keys & GAME_KEY_SPACE)
             {
                 game.state = STATE_QUIT;
             }
             break;
 
         case STATE_GAMEOVER:
-            if (game.keystate[SDL_SCANCODE_SPACE])
+            if (game.keys & GAME_KEY_SPACE)
             {
                 game.state = STATE_QUIT;
             }
@@ -542,51 +833,180 @@ static void Game_ProcessFrame()
         default:
             break;
     }
+}
+
+static void Game_ProcessFrame()
+{
+    // Read all events
+    SDL_Event event;
+    bool quitRequested = false;
+
+    TRACE_BEGIN("SDL_PollEvent");
+    while (SDL_PollEvent(&event))
+    {
+        if (event.type == SDL_QUIT)
+        {
+            quitRequested = true;
+        }
+        else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F12 && game.tracePath)
+        {
+            // The trace can be taken at any moment, not only at exit. The
+            // render thread and the jobs it runs record zones, so it waits.
+            Render_Pause();
+            Trace_Export(game.tracePath);
+            Render_Resume();
+        }
+        else if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET)
+        {
+            // The render target textures are lost
+            Types_InvalidateTiles(level);
+        }
+    }
+
+    TRACE_END();
+
+    Game_ReadKeys(quitRequested);
+
+    if (game.keys & GAME_KEY_QUIT)
+    {
+        game.state = STATE_QUIT;
+    }
+
+    // Process user input and game logic
+    while (FrameControl_NextStep())
+    {
+        TRACE_BEGIN("Game_ProcessStep");
+        Game_ProcessStep();
+        TRACE_END();
+    }
 
-    // Delete unused objects from memory
-    if (current_time >= game.cleanTime)
+    // Delete the removed objects, so they are never visited again
+    ObjectArray_Clean(&level->objects, &level->pool);
+
+    // Draw screen
+    if (!game.headless)
+    {
+        Game_DrawFrame();
+    }
+
+    game.frameCount += 1;
+    if (game.frameLimit > 0 && game.frameCount >= game.frameLimit)
     {
-        game.cleanTime = current_time + CLEAN_PERIOD;
-        // ObjectList_clean(&level->objects);
-        Types_ClearList(&level->objects);
+        game.state = STATE_QUIT;
     }
 
 #ifdef DEBUG_MODE
-    printf("fps=%f, objects=%d\n", getCurrentFps(), level->objects.count);
+    printf("fps=%f, objects=%d\n", FrameControl_GetCurrentFps(), level->objects.count);
 #endif
 }
 
 static void Game_OnExit()
 {
+    Replay_Stop();
     FrameControl_Deinit();
-    Render_Deinit();
+    Broadphase_Deinit();
+    HitBatch_Free(&game.hitBatch);
+    Levels_Deinit();
+
+    for (int i = 0; i < game.spawnBufferCount; i++)
+    {
+        free(game.spawnBuffers[i].objects);
+    }
+    free(game.spawnBuffers);
+    game.spawnBuffers = NULL;
+    game.spawnBufferCount = 0;
+
+    if (!game.headless)
+    {
+        Render_Deinit();
+        TTF_Quit();
+    }
+
+    // After the render thread, which runs jobs too
+    Jobs_Deinit();
+
+    // When no other thread records the zones
+    if (game.tracePath && !Trace_Export(game.tracePath))
+    {
+        printf("Could not write the trace %s\n", game.tracePath);
+    }
 
-    TTF_Quit();
     SDL_Quit();
 }
 
-void Game_Init()
+void Game_Init(const GameOptions* options)
 {
+    game.headless = options->headless;
+    game.frameLimit = options->frameLimit;
+    game.tickRate = options->tickRate;
+    game.frameReport = options->frameReport;
+    game.tracePath = options->tracePath;
+    game.frameCount = 0;
+    game.spawnBuffers = NULL;
+    game.spawnBufferCount = 0;
+    game.keys = 0;
+    HitBatch_Init(&game.hitBatch);
+
     atexit(Game_OnExit);
 
-    // Initialize SDL
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    if (game.tracePath && !TRACE_ENABLED)
+    {
+        printf("Tracing is disabled in this build, configure with -DPLATFORMER_TRACE=ON\n");
+        game.tracePath = NULL;
+    }
+    Trace_SetThreadName("main");
+
+    // Initialize SDL. Headless mode needs only events (e.g. SDL_QUIT on Ctrl+C),
+    // so it can run on a machine without a display.
+    if (SDL_Init(game.headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) < 0)
     {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
         exit(EXIT_FAILURE);
     }
 
-    // Initialize SDL_ttf
-    if (TTF_Init() < 0)
+    if (!game.headless)
     {
-        printf("SDL_ttf could not initialize! TTF_Error: %s\n", TTF_GetError());
+        // Initialize SDL_ttf
+        if (TTF_Init() < 0)
+        {
+            printf("SDL_ttf could not initialize! TTF_Error: %s\n", TTF_GetError());
+            exit(EXIT_FAILURE);
+        }
+
+        const RenderOptions renderOptions = {
+            .spritesPath = "image/sprites.bmp",
+            .fontPath = "font/PressStart2P.ttf",
+            .scale = options->windowScale,
+            .vsync = options->vsync,
+            .thread = options->renderThread,
+            .backend = options->renderBackend
+        };
+        Render_Init(&renderOptions);
+    }
+
+    // The replay gives the seed and the tick rate of the recorded session
+    ReplayHeader replayHeader = {options->seed, options->tickRate};
+
+    if (options->replayPath && !Replay_StartPlayback(options->replayPath, &replayHeader))
+    {
+        printf("Could not play the replay %s\n", options->replayPath);
+        exit(EXIT_FAILURE);
+    }
+
+    if (options->recordPath && !Replay_StartRecording(options->recordPath, &replayHeader))
+    {
+        printf("Could not record the replay %s\n", options->recordPath);
         exit(EXIT_FAILURE);
     }
 
-    Render_Init("image/sprites.bmp", "font/PressStart2P.ttf");
+    game.tickRate = replayHeader.tickRate;
+    Util_SeedRandom(replayHeader.seed);
+
+    Jobs_Init(options->threadCount > 0 ? options->threadCount : SDL_GetCPUCount());
+
     Types_InitTypes();
     Types_InitPlayer(&player);
-    Levels_Init();
+    Levels_Init(options->worldPath);
 
     game.keystate = SDL_GetKeyboardState(NULL);
     game.state = STATE_PLAYING;
@@ -594,11 +1014,52 @@ void Game_Init()
 
 void Game_run()
 {
-    FrameControl_Init(FRAME_RATE, MAX_DELTA_TIME);
+    if (game.headless || Replay_IsPlaying())
+    {
+        // The clock advances by exactly one frame period per frame, so the game
+        // behaves as if it runs at FRAME_RATE, but as fast as the CPU allows.
+        // A replay sets the recorded frame durations instead, and with a window
+        // it is played at the recorded speed.
+        FrameControl_InitSynthetic(FRAME_RATE, MAX_DELTA_TIME);
+        FrameControl_SetSyntheticPacing(!game.headless);
+    }
+    else
+    {
+        FrameControl_Init(FRAME_RATE, MAX_DELTA_TIME);
+    }
+
+    FrameControl_SetFixedStep(game.tickRate, MAX_STEPS_PER_FRAME);
+    // The render thread presents the frames, and the logic keeps its own pace
+    FrameControl_SetVsync(!game.headless && !Render_IsThreaded() && Render_IsVsync());
+
+    const uint64_t startCounter = SDL_GetPerformanceCounter();
 
     while (game.state != STATE_QUIT)
     {
+        TRACE_BEGIN("Frame");
         Game_ProcessFrame();
+        TRACE_END();
+
+        TRACE_BEGIN("FrameControl_WaitForNextFrame");
         FrameControl_WaitForNextFrame();
+        TRACE_END();
+
+        Replay_RecordFrame(game.keys, FrameControl_GetFrameTime());
+    }
+
+    if (game.headless)
+    {
+        const double realTime = (double)(SDL_GetPerformanceCounter() - startCounter)
+            / SDL_GetPerformanceFrequency();
+        printf("frames=%llu, game time=%.3f s, real time=%.3f s, fps=%.1f\n",
+            (unsigned long long)game.frameCount,
+            FrameControl_GetElapsedTime() / 1000.0,
+            realTime,
+            realTime > 0 ? game.frameCount / realTime : 0.0);
+    }
+
+    if (game.frameReport)
+    {
+        FrameControl_PrintReport(stdout);
     }
 }
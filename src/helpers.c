@@ -7,25 +7,29 @@
 #include "helpers.h"
 #include "game.h"
 #include "levels.h"
+#include "broadphase.h"
 #include <SDL_error.h>
 
 bool Util_IsCellValid(int r, int c)
 {
-    return r >= 0 && r < ROW_COUNT && c >= 0 && c < COLUMN_COUNT;
+    // Negative values become large, so one comparison per coordinate is enough
+    return (unsigned)r < (unsigned)level->rowCount && (unsigned)c < (unsigned)level->columnCount;
+}
+
+// Returns the SolidFlags and CellFlags of the cell, 0 outside the level
+static inline int Util_GetCellFlags(int r, int c)
+{
+    return Util_IsCellValid(r, c) ? level->cellFlags[Level_GetCell(level, r, c)] : 0;
 }
 
 bool Util_IsSolid(int r, int c, int flags)
 {
-    return Util_IsCellValid(r, c)
-        ? (level->cells[r][c]->solid & flags) == flags
-        : false;
+    return (Util_GetCellFlags(r, c) & flags) == flags;
 }
 
 bool Util_IsLadder(int r, int c)
 {
-    return Util_IsCellValid(r, c)
-        ? level->cells[r][c]->generalTypeId == TYPE_LADDER
-        : false;
+    return Util_GetCellFlags(r, c) & CELL_LADDER;
 }
 
 // Returns 1 if there is a ladder at (r, c) and player can stay on it
@@ -37,12 +41,20 @@ bool Util_isSolidLadder(int r, int c)
 
 bool Util_IsWater(int r, int c)
 {
-    return Util_IsCellValid(r, c) ? level->cells[r][c]->generalTypeId == TYPE_WATER : 0;
+    return Util_GetCellFlags(r, c) & CELL_WATER;
 }
 
 bool Util_CellContains(int r, int c, ObjectTypeId generalType)
 {
-    return Util_IsCellValid(r, c) ? level->cells[r][c]->generalTypeId == generalType : 0;
+    switch (generalType)
+    {
+        case TYPE_LADDER: return Util_GetCellFlags(r, c) & CELL_LADDER;
+        case TYPE_WATER:  return Util_GetCellFlags(r, c) & CELL_WATER;
+        case TYPE_SPIKE:  return Util_GetCellFlags(r, c) & CELL_SPIKE;
+        case TYPE_DOOR:   return Util_GetCellFlags(r, c) & CELL_DOOR;
+        default:
+            return Util_IsCellValid(r, c) ? Level_GetCellType(level, r, c)->generalTypeId == generalType : 0;
+    }
 }
 
 bool Util_HitTest(const Object* object1, const Object* object2)
@@ -50,24 +62,69 @@ bool Util_HitTest(const Object* object1, const Object* object2)
     const SDL_Rect o1 = object1->type->body;
     const SDL_Rect o2 = object2->type->body;
 
-    return (fabs((object1->x + o1.x + o1.w / 2.0) - (object2->x + o2.x + o2.w / 2.0)) < (o1.w + o2.w) / 2.0 &&
-            fabs((object1->y + o1.y + o1.h / 2.0) - (object2->y + o2.y + o2.h / 2.0)) < (o1.h + o2.h) / 2.0);
+    const double x1 = Scalar_ToDouble(object1->x);
+    const double y1 = Scalar_ToDouble(object1->y);
+    const double x2 = Scalar_ToDouble(object2->x);
+    const double y2 = Scalar_ToDouble(object2->y);
+
+    return (fabs((x1 + o1.x + o1.w / 2.0) - (x2 + o2.x + o2.w / 2.0)) < (o1.w + o2.w) / 2.0 &&
+            fabs((y1 + o1.y + o1.h / 2.0) - (y2 + o2.y + o2.h / 2.0)) < (o1.h + o2.h) / 2.0);
+}
+
+// Walks the cell borders that the leading edge crosses, in order, starting
+// from the border of the center cell, and tests the cells behind them. So the
+// box can not pass through a cell however far it moves in one step. If the
+// box already overlaps a stopping cell, the hit is at the start or behind it.
+bool Util_Sweep(const Sweep* sweep, SweepTest test, void* context, SweepHit* hit)
+{
+    const bool forward = sweep->side == SOLID_LEFT || sweep->side == SOLID_TOP;
+    const bool alongX = sweep->side == SOLID_LEFT || sweep->side == SOLID_RIGHT;
+    const double end = sweep->end;
+    const double distance = fabs(end - sweep->edge);
+
+    for (int k = 0; ; k++)
+    {
+        // The next cell and its border facing the box
+        const int next = forward ? sweep->cell + 1 + k : sweep->cell - 1 - k;
+        const double border = (forward ? next : next + 1) * (double)CELL_SIZE;
+
+        if (forward ? end <= border : end >= border)
+        {
+            return false;
+        }
+
+        for (int lane = sweep->laneFirst; lane <= sweep->laneLast; lane++)
+        {
+            const int r = alongX ? lane : next;
+            const int c = alongX ? next : lane;
+
+            if (test(context, r, c, sweep->side))
+            {
+                const double passed = forward ? border - sweep->edge : sweep->edge - border;
+                hit->r = r;
+                hit->c = c;
+                hit->edge = border;
+                hit->time = distance > 0 && passed > 0 ? passed / distance : 0;
+                return true;
+            }
+        }
+    }
 }
 
 void Util_GetObjectCell(const Object* object, int* r, int* c)
 {
     const SDL_Rect body = object->type->body;
-    *r = (object->y + body.y + body.h / 2.0) / CELL_SIZE;
-    *c = (object->x + body.x + body.w / 2.0) / CELL_SIZE;
+    *r = (Scalar_ToDouble(object->y) + body.y + body.h / 2.0) / CELL_SIZE;
+    *c = (Scalar_ToDouble(object->x) + body.x + body.w / 2.0) / CELL_SIZE;
 }
 
 void Util_GetObjectBody(const Object* object, Borders* borders)
 {
     const SDL_Rect body = object->type->body;
 
-    borders->left = object->x + body.x;
+    borders->left = Scalar_ToDouble(object->x) + body.x;
     borders->right = borders->left + body.w;
-    borders->top = object->y + body.y;
+    borders->top = Scalar_ToDouble(object->y) + body.y;
     borders->bottom = borders->top + body.h;
 }
 
@@ -107,14 +164,30 @@ bool Util_FindNearDoor(int* r, int* c)
     return false;
 }
 
+// Objects of a cell, grown to the largest cell queried on the thread
+static _Thread_local Object** cellObjects = NULL;
+static _Thread_local int cellObjectsReserved = 0;
+
 Object* Util_FindNearItem(int r, int c)
 {
-    // for (ObjectListNode* iter = level->objects.first; iter != NULL; iter = iter->next)
-    for (ListNode* iter = level->objects.first; iter != NULL; iter = iter->next)
+    const int maxCount = Broadphase_CountCell(r, c);
+
+    if (maxCount > cellObjectsReserved)
+    {
+        Object** objects = (Object**)realloc(cellObjects, maxCount * sizeof(Object*));
+        Util_EnsureSDL(objects != NULL, "Could not find an item.");
+        cellObjects = objects;
+        cellObjectsReserved = maxCount;
+    }
+
+    Object** objects = cellObjects;
+    const int count = Broadphase_QueryCell(r, c, objects, maxCount);
+
+    for (int i = 0; i < count; i++)
     {
-        Object* object = iter->data;
+        Object* object = objects[i];
 
-        if (object->type->generalTypeId == TYPE_ITEM && !object->removed)
+        if (object->type->generalTypeId == TYPE_ITEM)
         {
             int or, oc;
 
@@ -132,10 +205,9 @@ Object* Util_FindNearItem(int r, int c)
 
 Object* Util_FindObject(Level* level, ObjectTypeId typeId)
 {
-    // for (ObjectListNode* iter = level->objects.first; iter != NULL; iter = iter->next)
-    for (ListNode* iter = level->objects.first; iter != NULL; iter = iter->next)
+    for (int i = 0; i < level->objects.count; i++)
     {
-        Object* object = iter->data;
+        Object* object = level->objects.array[i];
 
         if (object->type->typeId == typeId)
         {
@@ -145,7 +217,48 @@ Object* Util_FindObject(Level* level, ObjectTypeId typeId)
     return NULL;
 }
 
-double Util_LimitAbs(double value, double max)
+// The game randomness, instead of rand(), whose sequence depends on the C
+// library. It is xorshift32: the state is never 0, so 0 seeds are replaced.
+static uint32_t randomState = 1;
+
+// The stream of the thread, while it is set
+static _Thread_local uint32_t streamState = 0;
+static _Thread_local bool streamActive = false;
+
+void Util_SeedRandom(uint32_t seed)
+{
+    randomState = seed != 0 ? seed : 1;
+}
+
+void Util_BeginRandomStream(uint32_t seed, uint32_t stream)
+{
+    // The murmur3 finalizer, so the neighbour streams are not alike
+    uint32_t state = seed ^ (stream * 0x9E3779B9u);
+    state ^= state >> 16;
+    state *= 0x85EBCA6Bu;
+    state ^= state >> 13;
+    state *= 0xC2B2AE35u;
+    state ^= state >> 16;
+
+    streamState = state != 0 ? state : 1;
+    streamActive = true;
+}
+
+void Util_EndRandomStream()
+{
+    streamActive = false;
+}
+
+int Util_Random()
+{
+    uint32_t* state = streamActive ? &streamState : &randomState;
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return (int)(*state >> 1);
+}
+
+Scalar Util_LimitAbs(Scalar value, Scalar max)
 {
     return (value >  max) ?  max :
            (value < -max) ? -max :
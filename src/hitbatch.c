@@ -0,0 +1,166 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#include "hitbatch.h"
+#include "helpers.h"
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The values are computed in the same order as in Util_HitTest(), and the
+// half sizes of integer sizes are exact, so the comparisons give the same
+// results as there
+
+void HitBatch_Init(HitBatch* batch)
+{
+    batch->centerX = NULL;
+    batch->centerY = NULL;
+    batch->halfW = NULL;
+    batch->halfH = NULL;
+    batch->objects = NULL;
+    batch->hits = NULL;
+    batch->count = 0;
+    batch->reserved = 0;
+}
+
+void HitBatch_Free(HitBatch* batch)
+{
+    free(batch->centerX);
+    free(batch->centerY);
+    free(batch->halfW);
+    free(batch->halfH);
+    free(batch->objects);
+    free(batch->hits);
+    HitBatch_Init(batch);
+}
+
+static void* HitBatch_Grow(void* array, int count, size_t size)
+{
+    void* grown = realloc(array, count * size);
+    Util_EnsureSDL(grown != NULL, "Could not reserve the hit batch.");
+    return grown;
+}
+
+static void HitBatch_Reserve(HitBatch* batch, int count)
+{
+    if (count <= batch->reserved)
+    {
+        return;
+    }
+
+    const int reserved = count * 2;
+    batch->centerX = (double*)HitBatch_Grow(batch->centerX, reserved, sizeof(double));
+    batch->centerY = (double*)HitBatch_Grow(batch->centerY, reserved, sizeof(double));
+    batch->halfW = (double*)HitBatch_Grow(batch->halfW, reserved, sizeof(double));
+    batch->halfH = (double*)HitBatch_Grow(batch->halfH, reserved, sizeof(double));
+    batch->objects = (Object**)HitBatch_Grow(batch->objects, reserved, sizeof(Object*));
+    batch->hits = (Object**)HitBatch_Grow(batch->hits, reserved, sizeof(Object*));
+    batch->reserved = reserved;
+}
+
+void HitBatch_Build(HitBatch* batch, const ObjectArray* objects, const Object* skip)
+{
+    HitBatch_Reserve(batch, objects->count);
+
+    int count = 0;
+
+    for (int i = 0; i < objects->count; i++)
+    {
+        Object* object = objects->array[i];
+
+        if (object == skip || object->removed)
+        {
+            continue;
+        }
+
+        const SDL_Rect body = object->type->body;
+        batch->centerX[count] = Scalar_ToDouble(object->x) + body.x + body.w / 2.0;
+        batch->centerY[count] = Scalar_ToDouble(object->y) + body.y + body.h / 2.0;
+        batch->halfW[count] = body.w / 2.0;
+        batch->halfH[count] = body.h / 2.0;
+        batch->objects[count] = object;
+        count++;
+    }
+
+    batch->count = count;
+}
+
+int HitBatch_Test(HitBatch* batch, const Object* object)
+{
+    const SDL_Rect body = object->type->body;
+    const double centerX = Scalar_ToDouble(object->x) + body.x + body.w / 2.0;
+    const double centerY = Scalar_ToDouble(object->y) + body.y + body.h / 2.0;
+    const double halfW = body.w / 2.0;
+    const double halfH = body.h / 2.0;
+
+    int hitCount = 0;
+    int i = 0;
+
+#if defined(__AVX__)
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    const __m256d cx = _mm256_set1_pd(centerX);
+    const __m256d cy = _mm256_set1_pd(centerY);
+    const __m256d hw = _mm256_set1_pd(halfW);
+    const __m256d hh = _mm256_set1_pd(halfH);
+
+    for (; i + 4 <= batch->count; i += 4)
+    {
+        const __m256d dx = _mm256_andnot_pd(signMask, _mm256_sub_pd(_mm256_loadu_pd(&batch->centerX[i]), cx));
+        const __m256d dy = _mm256_andnot_pd(signMask, _mm256_sub_pd(_mm256_loadu_pd(&batch->centerY[i]), cy));
+        const __m256d sw = _mm256_add_pd(_mm256_loadu_pd(&batch->halfW[i]), hw);
+        const __m256d sh = _mm256_add_pd(_mm256_loadu_pd(&batch->halfH[i]), hh);
+        int mask = _mm256_movemask_pd(_mm256_and_pd(
+            _mm256_cmp_pd(dx, sw, _CMP_LT_OQ), _mm256_cmp_pd(dy, sh, _CMP_LT_OQ)
+        ));
+
+        while (mask != 0)
+        {
+            batch->hits[hitCount++] = batch->objects[i + __builtin_ctz(mask)];
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    const __m128d cx = _mm_set1_pd(centerX);
+    const __m128d cy = _mm_set1_pd(centerY);
+    const __m128d hw = _mm_set1_pd(halfW);
+    const __m128d hh = _mm_set1_pd(halfH);
+
+    for (; i + 2 <= batch->count; i += 2)
+    {
+        const __m128d dx = _mm_andnot_pd(signMask, _mm_sub_pd(_mm_loadu_pd(&batch->centerX[i]), cx));
+        const __m128d dy = _mm_andnot_pd(signMask, _mm_sub_pd(_mm_loadu_pd(&batch->centerY[i]), cy));
+        const __m128d sw = _mm_add_pd(_mm_loadu_pd(&batch->halfW[i]), hw);
+        const __m128d sh = _mm_add_pd(_mm_loadu_pd(&batch->halfH[i]), hh);
+        const int mask = _mm_movemask_pd(_mm_and_pd(_mm_cmplt_pd(dx, sw), _mm_cmplt_pd(dy, sh)));
+
+        if (mask & 1)
+        {
+            batch->hits[hitCount++] = batch->objects[i];
+        }
+        if (mask & 2)
+        {
+            batch->hits[hitCount++] = batch->objects[i + 1];
+        }
+    }
+#endif
+
+    // The rest, or all without SIMD
+    for (; i < batch->count; i++)
+    {
+        if (fabs(batch->centerX[i] - centerX) < batch->halfW[i] + halfW &&
+            fabs(batch->centerY[i] - centerY) < batch->halfH[i] + halfH)
+        {
+            batch->hits[hitCount++] = batch->objects[i];
+        }
+    }
+
+    return hitCount;
+}
@@ -0,0 +1,187 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#include "jobs.h"
+#include "trace.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+enum { JOBS_MAX_WORKERS = 63 };
+
+static struct {
+    SDL_Thread* workers[JOBS_MAX_WORKERS];
+    int workerCount;
+
+    // The current run, changed only when no worker is busy
+    JobFunction function;
+    void* context;
+    int count;
+    SDL_atomic_t next;          // Index to take
+
+    SDL_mutex* runMutex;        // Held by the thread whose run it is
+    SDL_mutex* mutex;
+    SDL_cond* started;          // The generation changed, or quit
+    SDL_cond* finished;         // No worker is busy
+    int generation;
+    int busy;                   // Workers taking the indices of the current run
+    bool quit;
+} jobs = {0};
+
+static void Jobs_Work()
+{
+    int index;
+    while ((index = SDL_AtomicAdd(&jobs.next, 1)) < jobs.count)
+    {
+        jobs.function(jobs.context, index);
+    }
+}
+
+static int Jobs_Worker(void* data)
+{
+    (void)data;
+    Trace_SetThreadName("worker");
+
+    int generation = 0;
+    SDL_LockMutex(jobs.mutex);
+
+    for (;;)
+    {
+        while (jobs.generation == generation && !jobs.quit)
+        {
+            SDL_CondWait(jobs.started, jobs.mutex);
+        }
+        if (jobs.quit)
+        {
+            break;
+        }
+
+        generation = jobs.generation;
+        jobs.busy += 1;
+        SDL_UnlockMutex(jobs.mutex);
+
+        Jobs_Work();
+
+        SDL_LockMutex(jobs.mutex);
+        jobs.busy -= 1;
+        if (jobs.busy == 0)
+        {
+            SDL_CondSignal(jobs.finished);
+        }
+    }
+
+    SDL_UnlockMutex(jobs.mutex);
+    return 0;
+}
+
+void Jobs_Init(int threadCount)
+{
+    jobs.workerCount = 0;
+    jobs.generation = 0;
+    jobs.busy = 0;
+    jobs.quit = false;
+
+    const int workerCount = threadCount - 1 < JOBS_MAX_WORKERS ? threadCount - 1 : JOBS_MAX_WORKERS;
+    if (workerCount <= 0)
+    {
+        return;
+    }
+
+    jobs.runMutex = SDL_CreateMutex();
+    jobs.mutex = SDL_CreateMutex();
+    jobs.started = SDL_CreateCond();
+    jobs.finished = SDL_CreateCond();
+    if (!jobs.runMutex || !jobs.mutex || !jobs.started || !jobs.finished)
+    {
+        printf("Could not create the job threads, SDL_Error: %s\n", SDL_GetError());
+        return;
+    }
+
+    for (int i = 0; i < workerCount; i++)
+    {
+        SDL_Thread* worker = SDL_CreateThread(Jobs_Worker, "worker", NULL);
+        if (!worker)
+        {
+            printf("Could not create a job thread, SDL_Error: %s\n", SDL_GetError());
+            break;
+        }
+        jobs.workers[jobs.workerCount++] = worker;
+    }
+}
+
+void Jobs_Deinit()
+{
+    if (jobs.mutex)
+    {
+        SDL_LockMutex(jobs.mutex);
+        jobs.quit = true;
+        SDL_CondBroadcast(jobs.started);
+        SDL_UnlockMutex(jobs.mutex);
+    }
+
+    for (int i = 0; i < jobs.workerCount; i++)
+    {
+        SDL_WaitThread(jobs.workers[i], NULL);
+    }
+    jobs.workerCount = 0;
+
+    SDL_DestroyCond(jobs.finished);
+    SDL_DestroyCond(jobs.started);
+    SDL_DestroyMutex(jobs.mutex);
+    SDL_DestroyMutex(jobs.runMutex);
+    jobs.finished = NULL;
+    jobs.started = NULL;
+    jobs.mutex = NULL;
+    jobs.runMutex = NULL;
+}
+
+int Jobs_GetThreadCount()
+{
+    return jobs.workerCount + 1;
+}
+
+void Jobs_Run(JobFunction function, void* context, int count)
+{
+    // Waking the workers costs more than a single job. The logic and the
+    // render thread both run jobs, and the workers take one run at a time, but
+    // a thread does not wait for the other's run, which may be long (e.g. a
+    // slow frame), and does its jobs alone instead.
+    if (jobs.workerCount == 0 || count <= 1 || SDL_TryLockMutex(jobs.runMutex) != 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            function(context, i);
+        }
+        return;
+    }
+
+    SDL_LockMutex(jobs.mutex);
+
+    // A worker woken late for the previous run may still be looking for indices
+    while (jobs.busy > 0)
+    {
+        SDL_CondWait(jobs.finished, jobs.mutex);
+    }
+
+    jobs.function = function;
+    jobs.context = context;
+    jobs.count = count;
+    SDL_AtomicSet(&jobs.next, 0);
+    jobs.generation += 1;
+    SDL_CondBroadcast(jobs.started);
+    SDL_UnlockMutex(jobs.mutex);
+
+    Jobs_Work();
+
+    // All indices are taken, the busy workers finish theirs
+    SDL_LockMutex(jobs.mutex);
+    while (jobs.busy > 0)
+    {
+        SDL_CondWait(jobs.finished, jobs.mutex);
+    }
+    SDL_UnlockMutex(jobs.mutex);
+    SDL_UnlockMutex(jobs.runMutex);
+}
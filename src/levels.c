@@ -8,9 +8,36 @@
 #include "render.h"
 #include "game.h"
 #include "helpers.h"
+#include "world.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// State of a level that is not resident: its objects as they were, in the
+// same order, so the restored level behaves exactly the same, and its tiles.
+// The tiles are run-length encoded, as (length, id) pairs, a row by row.
+typedef struct {
+    int count;
+    int tilesSize;              // Bytes of the encoded tiles, after the objects
+    Object objects[];           // Without the player
+} LevelSnapshot;
+
+typedef struct {
+    Level level;
+    int index;                  // Level in the world, -1 if the slot is free
+    uint64_t lastUse;
+} LevelSlot;
+
+static struct {
+    World source;
+    LevelSlot slots[LEVEL_RESIDENT_MAX];
+    int residentLimit;
+    uint64_t useCounter;
+    LevelSnapshot** saved;      // Per level, NULL if it is resident or was not played yet
+    uint8_t* tiles;             // Tiles of a level being restored
+    uint32_t seed;              // Of the random streams of the created levels
+} world = {.residentLimit = LEVEL_RESIDENT_MAX};
 
-Level levels[LEVEL_COUNTY][LEVEL_COUNTX];
-static const char* levelsString;
 
 
 static void changeSprite(ObjectTypeId typeId, int spriteRow, int spriteColumn)
@@ -73,371 +100,270 @@ static void changeSprites_Underground()
     changeSprite(TYPE_LADDER,          12, 2 );
 }
 
-static inline const char* getLevelString(const char* allLevels, int r, int c)
+// Fills the empty level with the level lr, lc of the world. The objects get
+// the random numbers of the level's own stream, so a level created again is
+// the same, and the other levels do not depend on when it is created.
+static void createLevel(Level* level, int lr, int lc)
 {
-    return allLevels + r * CELL_COUNT * LEVEL_COUNTX + c * COLUMN_COUNT;
-}
+    Types_SetTiles(level, World_GetTiles(&world.source, lr, lc));
+    ObjectArray_Append(&level->objects, (Object*)&player);
 
-static inline char getLevelChar(const char* levelString, int r, int c)
-{
-    return levelString[r * COLUMN_COUNT * LEVEL_COUNTX + c];
+    int count = 0;
+    const WorldSpawn* spawns = World_GetSpawns(&world.source, lr, lc, &count);
+    Util_BeginRandomStream(world.seed, lr * world.source.countX + lc);
+
+    for (int i = 0; i < count; i++)
+    {
+        Object* object = Types_CreateObject(level, spawns[i].typeId, spawns[i].r, spawns[i].c);
+
+        if (spawns[i].typeId == TYPE_ACTION)
+        {
+            object->data = spawns[i].data;
+        }
+        else if (spawns[i].typeId == TYPE_DROP)
+        {
+            const int top = Scalar_ToInt(object->y) / CELL_SIZE * CELL_SIZE;
+            object->y = Scalar_FromInt(top) - SCALAR((CELL_SIZE - object->type->body.h) / 2.0 + 1);
+        }
+    }
+
+    Util_EndRandomStream();
+
+    // ObjectArray_sortByDepth(&level->objects);
 }
 
-static void initLevelsFromString(const char* string)
+// Returns the size of the encoded tiles, and writes them if runs is not NULL.
+// A run does not cross a row, and a longer one is split, so its length fits
+// a byte.
+static int encodeTiles(const Level* level, uint8_t* runs)
 {
-    struct { int r, c; } startLevel;
+    int size = 0;
 
-    // Iterate over the levels
-    for (int lr = 0; lr < LEVEL_COUNTY; lr++)
+    for (int r = 0; r < level->rowCount; r++)
     {
-        for (int lc = 0; lc < LEVEL_COUNTX; lc++)
-        {
-            const char* levelString = getLevelString(string, lr, lc);
+        const uint8_t* row = &level->tiles[Level_GetCell(level, r, 0)];
 
-            Level* level = &levels[lr][lc];
-            Types_InitLevel(level);
-            level->r = lr;
-            level->c = lc;
-            // ObjectArray_append(&level->objects, (Object*)&player);
-            List_Insert(&level->objects, &player);
+        for (int c = 0; c < level->columnCount;)
+        {
+            const uint8_t id = row[c];
+            int length = 1;
+            while (c + length < level->columnCount && row[c + length] == id && length < UINT8_MAX)
+            {
+                length++;
+            }
 
-            // Iterate over the level cells and create objects
-            for (int r = 0; r < ROW_COUNT; r++)
+            if (runs)
             {
-                for (int c = 0; c < COLUMN_COUNT; c++)
-                {
-                    const char s = getLevelChar(levelString, r, c);
-
-                    // Wall and ground
-                    if (s == '*' || s == 'x')
-                    {
-                        const ObjectTypeId type = s == '*' ? TYPE_WALL : TYPE_GROUND;
-                        const ObjectTypeId type_top = s == '*' ? TYPE_WALL_TOP : TYPE_GROUND_TOP;
-                        const char st = getLevelChar(levelString, r - 1, c);
-                        if (r == 0 || st == '*' || st == 'x')
-                        {
-                            Types_CreateStaticObject(level, type, r, c);
-                        }
-                        else
-                        {
-                            Types_CreateStaticObject(level, type_top, r, c);
-                        }
-                    // Water
-                    }
-                    else if (s == '~')
-                    {
-                        const char st = getLevelChar(levelString, r - 1, c);
-                        if (r == 0 || st == '~' || st == 'x' || st == '*') {
-                            Types_CreateStaticObject(level, TYPE_WATER, r, c);
-                        } else {
-                            Types_CreateObject(level, TYPE_WATER_TOP, r, c);
-                        }
-                    // Pillar
-                    }
-                    else if (s == '|')
-                    {
-                        const char st = getLevelChar(levelString, r - 1, c);
-                        const char sb = getLevelChar(levelString, r + 1, c);
-                        if (r == 0 || st == '*' || st == 'x') {
-                            Types_CreateStaticObject(level, TYPE_PILLAR_TOP, r, c);
-                        } else if (r == ROW_COUNT - 1 || sb == '*' || sb == 'x') {
-                            Types_CreateStaticObject(level, TYPE_PILLAR_BOTTOM, r, c);
-                        } else {
-                            Types_CreateStaticObject(level, TYPE_PILLAR, r, c);
-                        }
-                    // Spike
-                    }
-                    else if (s == '^')
-                    {
-                        const char st = getLevelChar(levelString, r - 1, c);
-                        if (st == '*' || st == 'x') {
-                            Types_CreateStaticObject(level, TYPE_SPIKE_TOP, r, c);
-                        } else {
-                            Types_CreateStaticObject(level, TYPE_SPIKE_BOTTOM, r, c);
-                        }
-                    // Other objects
-                    }
-                    else if (s == '-')
-                    {
-                        Types_CreateStaticObject(level, TYPE_WALL_STAIR, r, c);
-                    }
-                    else if (s == ',')
-                    {
-                        Types_CreateStaticObject(level, (c + 1) % 3 ? TYPE_GRASS : TYPE_GRASS_BIG, r, c);
-                    }
-                    else if (s == '.')
-                    {
-                        Types_CreateStaticObject(level, TYPE_MUSHROOM1 + c % 3, r, c);
-                    }
-                    else if (s == ';')
-                    {
-                        Types_CreateStaticObject(level, c % 2 ? TYPE_TREE1 : TYPE_TREE2, r, c);
-                    }
-                    else if (s == '@')
-                    {
-                        Types_CreateStaticObject(level, TYPE_ROCK, r, c);
-                    }
-                    else if (s == '=')
-                    {
-                        Types_CreateStaticObject(level, TYPE_LADDER, r, c);
-                    }
-                    else if (s == 'd')
-                    {
-                        Types_CreateStaticObject(level, TYPE_DOOR, r, c);
-                    }
-                    else if (s == 'o')
-                    {
-                        Types_CreateObject(level, TYPE_COIN, r, c);
-                    }
-                    else if (s == 'O')
-                    {
-                        Types_CreateObject(level, TYPE_GEM, r, c);
-                    }
-                    else if (s == 'k')
-                    {
-                        Types_CreateObject(level, TYPE_KEY, r, c);
-                    }
-                    else if (s == 'h')
-                    {
-                        Types_CreateObject(level, TYPE_HEART, r, c);
-                    }
-                    else if (s == 'a')
-                    {
-                        Types_CreateObject(level, TYPE_APPLE, r, c);
-                    }
-                    else if (s == 'i')
-                    {
-                        Types_CreateObject(level, TYPE_PEAR, r, c);
-                    }
-                    else if (s == 'S')
-                    {
-                        Types_CreateObject(level, TYPE_STATUARY, r, c);
-                    }
-                    else if (s == 'g')
-                    {
-                        Types_CreateObject(level, TYPE_GHOST, r, c);
-                    }
-                    else if (s == 's')
-                    {
-                        Types_CreateObject(level, TYPE_SCORPION, r, c);
-                    }
-                    else if (s == 'p')
-                    {
-                        Types_CreateObject(level, TYPE_SPIDER, r, c);
-                    }
-                    else if (s == 'r')
-                    {
-                        Types_CreateObject(level, TYPE_RAT, r, c);
-                    }
-                    else if (s == 'b')
-                    {
-                        Types_CreateObject(level, TYPE_BAT, r, c);
-                    }
-                    else if (s == 'q')
-                    {
-                        Types_CreateObject(level, TYPE_BLOB, r, c);
-                    }
-                    else if (s == 'f')
-                    {
-                        Types_CreateObject(level, TYPE_FIREBALL, r, c);
-                    }
-                    else if (s == 'e')
-                    {
-                        Types_CreateObject(level, TYPE_SKELETON, r, c);
-                    }
-                    else if (s == '`')
-                    {
-                        Object* drop = Types_CreateObject(level, TYPE_DROP, r, c);
-                        drop->y = (drop->y / CELL_SIZE) * CELL_SIZE - (CELL_SIZE - drop->type->body.h) / 2.0 - 1;
-                    }
-                    else if (s == '_')
-                    {
-                        Types_CreateObject(level, TYPE_PLATFORM, r, c);
-                    }
-                    else if (s == '/')
-                    {
-                        Types_CreateObject(level, TYPE_SPRING, r, c);
-                    }
-                    else if (s == '<')
-                    {
-                        Types_CreateStaticObject(level, TYPE_ARROW_LEFT, r, c);
-                    }
-                    else if (s == '>')
-                    {
-                        Types_CreateStaticObject(level, TYPE_ARROW_RIGHT, r, c);
-                    }
-                    else if (s == '&')
-                    {
-                        Types_CreateObject(level, TYPE_CLOUD1, r, c);
-                    }
-                    else if (s == '!')
-                    {
-                        Types_CreateObject(level, TYPE_TORCH, r, c);
-                    }
-                    else if (s >= '1' && s <= '9')
-                    {
-                        Object* action = Types_CreateObject(level, TYPE_ACTION, r, c);
-                        action->data = s;
-                    // Start position
-                    }
-                    else if (s == 'P')
-                    {
-                        startLevel.r = lr;
-                        startLevel.c = lc;
-                        player.y = CELL_SIZE * r;
-                        player.x = CELL_SIZE * c;
-                    }
-                }
+                runs[size] = (uint8_t)length;
+                runs[size + 1] = id;
             }
+            size += 2;
+            c += length;
+        }
+    }
+
+    return size;
+}
+
+static void saveLevel(const Level* level, int index)
+{
+    const int tilesSize = encodeTiles(level, NULL);
+    const int count = level->objects.count - 1;
+    LevelSnapshot* snapshot = (LevelSnapshot*)malloc(sizeof(LevelSnapshot) + count * sizeof(Object) + tilesSize);
+    Util_EnsureSDL(snapshot != NULL, "Could not save the level.");
 
-            // ObjectArray_sortByDepth(&level->objects);
+    snapshot->tilesSize = tilesSize;
+    encodeTiles(level, (uint8_t*)(snapshot->objects + count));
+
+    // The removed objects too, as the order of the rest depends on them
+    snapshot->count = count;
+    for (int i = 0; i < count; i++)
+    {
+        snapshot->objects[i] = *level->objects.array[i + 1];
+    }
+
+    world.saved[index] = snapshot;
+}
+
+static void restoreLevel(Level* level, int index)
+{
+    LevelSnapshot* snapshot = world.saved[index];
+    const uint8_t* runs = (const uint8_t*)(snapshot->objects + snapshot->count);
+    int cell = 0;
+
+    for (int i = 0; i < snapshot->tilesSize; i += 2)
+    {
+        memset(world.tiles + cell, runs[i + 1], runs[i]);
+        cell += runs[i];
+    }
+
+    Types_SetTiles(level, world.tiles);
+
+    ObjectArray_Append(&level->objects, (Object*)&player);
+    for (int i = 0; i < snapshot->count; i++)
+    {
+        Object* object = ObjectPool_Alloc(&level->pool);
+        *object = snapshot->objects[i];
+        ObjectArray_Append(&level->objects, object);
+    }
+
+    free(snapshot);
+    world.saved[index] = NULL;
+    level->played = true;
+}
+
+// A free slot, or the least recently used one except the current level. Only
+// the levels that were played are saved, the rest are created again from the
+// world when they are needed.
+static LevelSlot* takeSlot()
+{
+    LevelSlot* lru = NULL;
+
+    for (int i = 0; i < world.residentLimit; i++)
+    {
+        LevelSlot* slot = &world.slots[i];
+        if (slot->index < 0)
+        {
+            return slot;
         }
+        if (&slot->level != level && (!lru || slot->lastUse < lru->lastUse))
+        {
+            lru = slot;
+        }
+    }
+
+    if (lru->level.played)
+    {
+        saveLevel(&lru->level, lru->index);
     }
+    lru->index = -1;
+    return lru;
+}
 
-    // Set start level
-    Game_SetLevel(startLevel.r, startLevel.c);
+void Levels_SetResidentLimit(int count)
+{
+    world.residentLimit = count < LEVEL_RESIDENT_MIN ? LEVEL_RESIDENT_MIN : count > LEVEL_RESIDENT_MAX ? LEVEL_RESIDENT_MAX : count;
 }
 
-void Levels_Init()
+int Levels_GetCountX()
 {
-    Util_EnsureSDL(strlen(levelsString) == LEVEL_COUNTY * LEVEL_COUNTX * ROW_COUNT * COLUMN_COUNT,
-           "The levels string does not match the levels count or size.");
+    return world.source.countX;
+}
 
-    initLevelsFromString(levelsString);
+int Levels_GetCountY()
+{
+    return world.source.countY;
+}
 
-    for (int r = 0; r < LEVEL_COUNTY; r++) {
-        for (int c = 0; c < LEVEL_COUNTX; c++) {
-            levels[r][c].init = changeSprites_Underground;
+Level* Levels_Get(int r, int c)
+{
+    if (r < 0 || c < 0 || r >= world.source.countY || c >= world.source.countX)
+    {
+        return NULL;
+    }
+
+    const int index = r * world.source.countX + c;
+    LevelSlot* slot = NULL;
+
+    for (int i = 0; i < world.residentLimit && !slot; i++)
+    {
+        if (world.slots[i].index == index)
+        {
+            slot = &world.slots[i];
         }
     }
 
+    if (!slot)
+    {
+        slot = takeSlot();
+        Level* level = &slot->level;
+        Types_ResetLevel(level);
+
+        if (world.saved[index])
+        {
+            restoreLevel(level, index);
+        }
+        else
+        {
+            createLevel(level, r, c);
+        }
+
+        level->r = r;
+        level->c = c;
+        level->init = changeSprites_Underground;
+        slot->index = index;
+    }
+
+    world.useCounter += 1;
+    slot->lastUse = world.useCounter;
+    return &slot->level;
+}
+
+void Levels_Prefetch(int r, int c)
+{
+    Levels_Get(r, c - 1);
+    Levels_Get(r, c + 1);
+    Levels_Get(r - 1, c);
+    Levels_Get(r + 1, c);
+}
+
+void Levels_Init(const char* worldPath)
+{
+    if (!worldPath)
+    {
+        worldPath = LEVELS_DEFAULT_WORLD;
+    }
+
+    if (!World_Open(&world.source, worldPath))
+    {
+        printf("Could not load the world %s: %s\n", worldPath, World_GetError());
+        exit(EXIT_FAILURE);
+    }
+
+    const int rowCount = world.source.rowCount;
+    const int columnCount = world.source.columnCount;
+
+    world.useCounter = 0;
+    world.seed = Util_Random();
+    world.saved = (LevelSnapshot**)calloc(world.source.countX * world.source.countY, sizeof(LevelSnapshot*));
+    world.tiles = (uint8_t*)malloc(rowCount * columnCount);
+    Util_EnsureSDL(world.saved && world.tiles, "Could not allocate the levels.");
+
+    for (int i = 0; i < LEVEL_RESIDENT_MAX; i++)
+    {
+        Types_InitLevel(&world.slots[i].level, rowCount, columnCount);
+        world.slots[i].index = -1;
+    }
+
+    // Start position
+    player.y = Scalar_FromInt(CELL_SIZE * (world.source.startR % rowCount));
+    player.x = Scalar_FromInt(CELL_SIZE * (world.source.startC % columnCount));
+
+    Game_SetLevel(world.source.startR / rowCount, world.source.startC / columnCount);
+
     // Special objects can be created here
 }
 
+void Levels_Deinit()
+{
+    for (int i = 0; i < LEVEL_RESIDENT_MAX; i++)
+    {
+        Types_DeinitLevel(&world.slots[i].level);
+        world.slots[i].index = -1;
+    }
+
+    if (world.saved)
+    {
+        for (int i = 0; i < world.source.countX * world.source.countY; i++)
+        {
+            free(world.saved[i]);
+        }
+        free(world.saved);
+        world.saved = NULL;
+    }
+
+    free(world.tiles);
+    world.tiles = NULL;
 
-// There must be exactly LEVEL_COUNTX * LEVEL_COUNTY levels here
-
-static const char* levelsString =
-
-"                    "  " *     b       b    "
-"  ooooooo S ooooooo "  " d                  "
-"=*******************"  "**** _       ****=**"
-"=                   "  "*                =  "
-"=    o    o    o    "  "*                =  "
-"=                   "  "*    ooo    p    =  "
-"***     _        **="  "*oo ----  **********"
-"                   ="  "*-- -               "
-"    f  o     o     ="  "*   -  p  ooo       "
-"              f    ="  "*     --=-----  o  O"
-"=**       _      ***"  "*       =       -  -"
-"=                   "  "*   b   =           "
-"=    o    o    o    "  "*       =           "
-"=      s            "  "*       =   g       "
-"****************  -*"  "*=***************   "
-
-"*           *   o -*"  " =                O "
-"*           *   - o*"  " =               ---"
-"*    o o o  *   o -*"  " =          oo      "
-"*  k    e   >   - o*"  " =  g oooo       goo"
-"*******=*****     -*"  " **********    *****"
-"*      =    *-  -  *"  "                    "
-"* h    =    *      *"  "   o o o    /       "
-"*    -----  *      *"  "          ------    "
-"*         - * o e o*"  "               -  ks"
-"*          **=******"  " oo  o / o     -----"
-"*-          *=      "  " ***=*****          "
-"*-  o o/ og *=      "  "    =               "
-"*- **********=      "  "    =           o   "
-"*-   ooo    <=      "  " P  = ooooo  s **~~~"
-"********************"  "*****************~~~";
-
-// Experiments
-
-/*
-static const char* levelsString =
-
-"    &           &   "  "                    "  "                  * "  "  `                *"  "*                  *"
-" P        &         "  "                    "  " _              *   "  "        o s       o*"  "*          o       *"
-"xxxxx               "  "                    "  " k  k  _        ****"  "****  ********  =***"  "*         ***      *"
-"xxx                 "  "                    "  "kakiaik          ***"  "                =  *"  "*       ***     g  *"
-"xx                  "  "                    "  "*******  ******  ***"  "             =******"  "*os    *  *  =******"
-"x                   "  "                    "  "                 ***"  " g o         =     *"  "******    *  =      "
-"x                   "  "    b               "  "        &        ***"  "*****     *****=****"  "*     *  **  =      "
-"xxxxx  ,,;,, a ,;,, "  ",,,                 "  "                 ***"  "               =   *"  "* s     ***  =    o "
-"xxxxxxxxxxxxxxxxxxxx"  "xxxx                "  "   _          _  ***"  "   o  o      f =   *"  "******=********* ***"
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxx   ,,;,      "  "                 ***"  "  **  ** ***********"  "*     =     *   o   "
-"  xxx ` x  ` x  ` xx"  "xxxxx    xxxxxx     "  "                 ***"  "*        |  ` |   `|"  "  go  =   g *  ***  "
-"   ^    ^    ^    ^ "  " |      xxxxxxxxx   "  "                 ***"  "**       |    |    |"  "****  =  ****       "
-"                    "  " |        |    xxx  "  "     b      b    ***"  " **      |    |    |"  "      =     *       "
-"  .    s  .         "  " |. ,,,,s | . xxxxxx"  "x ,,, d,;,k d,,,,d d"  "    *  s | o  |  s |"  "      = o   *     g "
-"xxxx~~xxxxxxxxxxxxxx"  "xxxxxxxxxxxxx=xxxxxx"  "xxxxxxxxxxxxxxxxx***"  "=*******************"  "***************=****"
-
-"xxxx  xxxxxxxxxxxxxx"  "xxxxxxxxxxxxx=xxxxxx"  "xxxxxxxxxxxxxxxxxx**"  "********************"  "               =    "
-"xxx   `xxxxxxxxxxxxx"  "xxxxxxxxxxxx = xxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "**         * ooooo *"  "   b           =    "
-"x ^      xxx `  xxxx"  "xxx  ^  xxxx =  xxxx"  "xx   ^   b    ^   xx"  "**         d ooooo *"  "               =    "
-"x               `  x"  "x        |   =  ^  x"  "x                 xx"  "**     =************"  "          b    =    "
-"x       xxxxxx      "  "         | p =     |"  "      xxxxxxx     xx"  "** o   =    g       "  "               =    "
-"x      xxxxxxxx   xx"  "xxxx  xxxxxxxxxxxxxx"  "xxxx   xxxxx      xx"  "*****  =   *****    "  "               =    "
-"x   xxxxxxxxxxx  xxx"  "x ^    xxxxxxxxxxxxx"  "xxx               x*"  "**     =            "  "               =    "
-"xx  `xxxxxxxxx      "  "   b    |     | xxxx"  "xx            r     "  "       =    s       "  "                    "
-"xxx   xxxxxxxxxxxxxx"  "x       |     |     "  " | q         xxxxx**"  "**************=*****"  "*******      *******"
-"xxxx  xxxxxxxxxxxxxx"  "x    xxxxxxxxxxxxxxx"  "xxxxxx  x      xxxx*"  "**   b        =   **"  "***         -    ***"
-"xxxx  xxxxxxxxxxxxxx"  "x @    xxxxxxxxxxxxx"  "xxxx             xxx"  "x*  o   o     =   **"  "**       x        **"
-"xxxx  xxxxxxxxxxxxxx"  "xxxxx     | b       "  " |                xx"  "x***********      xx"  "xx       |        xx"
-"xxx    xxxxxxxxxxxxx"  "x  xxx    |         "  "e|                xx"  "xx                xx"  "xxx      |      .xxx"
-"          .         "  "  k xxx~~xxx~~xx~~xx"  "xxx~~~~~~~~~~~~~~~xx"  "xx~~~~~~~~~~~~~~~~xx"  "xxxx~~~~~x~~~~~~xxxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxx~~xxx~~xx~~xx"  "xxxx~~~~~~~~~~~~~~xx"  "xx~~~~~~~~~~~~~~~~xx"  "xxxx~~~~~x~~~~~~xxxx";
-//*/
-
-/*
-static const char* levelsString =
-
-//         0                       1                       2                       3                       4                      5
-"                    "  "         &          "  "                    "  "                    "  "                    " "                    "
-"                    "  "o  ooo            & "  "                    "  "                    "  "                    " "                    "
-"                    "  "------   oo  xxx    "  "                    "  "                    "  "                    " "                    "
-"                    "  " f  -  -xxxxx       "  "                    "  "                    "  "                    " "                    "
-"                    "  "    ---             "  "                    "  "                    "  "                    " "                    "
-"                    "  "   o-o     g   o    "  "                    "  "                    "  "                    " "                    "
-"                    "  "------    xxx xxx  -"  "                    "  "                    "  "                    " "                    " // 0
-"                    "  "    -  ---         -"  "                    "  "                    "  "                    " "                    "
-"                    "  "    ----       o   -"  "                    "  "                    "  "                    " "                    "
-"                    "  "  -----   --  xxxx -"  "   o  o  o          "  "                    "  "                    " "                    "
-"                    "  "x    g             -"  "   -  -  -   oo     "  "                    "  "                    " "                    "
-"                    "  " xxxxxxxxxx        -"  "      -     ---  oo "  "                    "  "                    " "                    "
-"                    "  " ,,   ,   ,,xx,;,P -"  "      -          -- "  "                    "  "                    " "                    "
-"                    "  "xxxxxxxxxxxxxxxxxxxx"  "   xxxxxxxxxxxxx    "  "                    "  "                    " "                    "
-"                    "  "xxxxxxxxxxxxxxxxxxxx"  "                    "  "                    "  "                    " "***********=********"
-
-"                    "  "                    "  "              ******"  "********************"  "********************" "***********=********"
-"     &      &       "  "     &              "  "   &          ******"  "**                **"  "**               ***" "***********=********"
-"                    "  "               &    "  "        &           "  "                    "  "                    " "           =        "
-"        &           "  "                    "  "              *     "  "                    "  "             g      " "           =        "
-"                    "  "                    "  "              ******"  "********************"  "**********=*********" "********************"
-"                    "  "                    "  "              ******"  "**               |  "  "          =         " "                    "
-"                    "  "                    "  "              ******"  "**               |  "  "    !     =    !    " "                    " // 1
-"                    "  " ,;                 "  "              ******"  "**               |  "  "    g     =         " "                    "
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxx           "  "              ******"  "**              ****"  "********************" "***********         "
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxx            "  "              ******"  "**             *****"  "********************" "************        "
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxx             "  "              ******"  "**            ******"  "***      **  `   `  " "          ***       "
-"xxxxxxxxxxxxxxxxxxxx"  "xxx  |              "  "              ***   "  "      !      *******"  "**       *          " "     !     ***      "
-"xxxxxxxxxxxxxxxxxxxx"  "x    |    @ ,,,     "  "     ,;,      d     "  "            ********"  "***1*   2d          " "                    "
-"xxxxxxxxxxxxxxxxxxxx"  "x    xxxxxxxxxxxxxxx"  "xxxxxxxxxxxxxx******"  "********************"  "**** ***************" "********************"
-"xxxxxxxxxxxxxxxxxxxx"  "x  xxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxxx******"  "********************"  "**** ***************" "********************"
-
-"xxxxxxxxxxxxxxxxxxxx"  "xx  xxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxxx******"  "********************"  "**** ***************" "********************"
-"xxxxxxxxxxxxxxxxxxxx"  "xxx      xx  xx xxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xxxx xxxxxxxxxxxxxxx" "xxxxxxxxxxxxxxxxxxxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxx      |      "  "      |        |    "  "   x  x `  xxxxxxxxx"  "xx    xxxxxxxxxxxxxx" "xxxxxxxxxxxxxxxxxxxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxx .  |    xx"  "x    xxx       |  xx"  "x  `      xxxxx` xxx"  "x       xxxx   x  xx" "xxxxxxxxxxxxxxxxxxxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xxx xxxxxx   xxxxxxx"  "xx   b       ^   xxx"  "xxx      ^  b  ^   x" "x    xxxxxxxxxxxxxxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xxxx  xxxxxxxxxxxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xxxxxx xxxx     xxxx"  "xxxxxx           .  " "       xxxxxxx  xxxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xxx    xxxxxxxxxxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxx    xxx"  "xxxxxxxxxxxxx  xxxxx" "x    xxxxxxxx    xxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xx    xxxxxxxxxxxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxxxx   xx"  "xxxxxxxxxxx     xxxx" "xxx xxxxxxxx        " // 2
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxx  |    xxxx"  "xxx   x  |   x    xx" "xxxxxxxxxxxxxx    xx"
-"xxxxxxxxxxxxxxx xxxx"  "xxxxxxxxxx  xxxxxxxx"  "xxx xxxxxxxxxxx  xxx"  "xxxxxxxx   |   xxxxx"  "xxxx     |  xxx   xx" "xxxxxxxxxxxxxxxx xxx"
-"xxxxxxxxxxx ^    xxx"  "xxx  xx      xx  xx "  "xx   xx   xx  ^   xx"  "xxx ^ x   xxxx  xxxx"  "x        xxxxxxxxxxx" "xxxxxxxxxxx` xxxxxxx"
-"xxxxxxxxxx          "  " ^    ^  xx         "  "     ^             x"  "x        xxxxxx     "  "   xxxxxxxxxxxxxxxxx" "xxxxxxxxx     xxxxxx"
-"xxxxxxxxxxxxxxxx    "  "   r    xxxx        "  "        xxxxx     xx"  "xx    . xxxxxxxx xxx"  "xx  xxxxxxxxxxxxxxx " " ^ xxxxx   xxxxxxxxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxxx~~xx~~x"  "~~xx~~xxxxxxxx . xxx"  "xxx  xxxxxxxxxxxxxxx"  "xx~~xxxxxxxxxxxxxx  " "      .  xxxxxxxxxxx"
-"xxxxxxxxxxxxxxxxxxxx"  "xxxxxxxxxxxx~~~~~~~~"  "~~~~~~xxxxxxxxxxxxxx"  "xxxxxxxxxxxxxxxxxxxx"  "xx~~xxxxxxxxxxxxxxxx" "x xx xxxxxxxxxxxxxxx";
-//*/
+    World_Close(&world.source);
+}
@@ -5,10 +5,117 @@
  ******************************************************************************/
 
 #include "game.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void printUsage(const char* program)
+{
+    printf("Usage: %s [--headless] [--frames N] [--tickrate N] [--vsync] [--frame-report]\n"
+           "       [--seed N] [--record FILE] [--replay FILE] [--trace FILE] [--world FILE]\n"
+           "       [--threads N] [--no-render-thread] [--scale N] [--renderer NAME]\n", program);
+    printf("  --headless   Run the game logic only: no window, no rendering, no frame pacing\n");
+    printf("  --frames N   Quit after N frames\n");
+    printf("  --tickrate N Run the game logic at N fixed steps per second, independently of the frame rate\n");
+    printf("  --vsync      Present the frames at the display refresh\n");
+    printf("  --frame-report Print the frame timing report at exit\n");
+    printf("  --seed N     Seed the game randomness with N\n");
+    printf("  --record FILE Record the input to the replay FILE\n");
+    printf("  --replay FILE Play the replay FILE instead of the keyboard, with its seed and tick rate\n");
+    printf("  --trace FILE Write the trace to FILE at exit and on F12 (needs PLATFORMER_TRACE)\n");
+    printf("  --world FILE Play the world FILE, a source or compiled by platformer_levelc\n");
+    printf("  --threads N  Update the objects on N threads, one per CPU by default\n");
+    printf("  --no-render-thread Draw and present the frames on the logic thread\n");
+    printf("  --scale N    Open the window at N times the screen size, %d by default\n", WINDOW_SCALE);
+    printf("  --renderer NAME Draw by sdl, by the in-tree raster(izer), or auto: raster if SDL has no GPU\n");
+}
 
 int main(int argc, char* argv[])
 {
-    Game_Init();
+    GameOptions options = {
+        .headless = false,
+        .frameLimit = 0,
+        .tickRate = 0,
+        .vsync = false,
+        .frameReport = false,
+        .seed = 1,
+        .recordPath = NULL,
+        .replayPath = NULL,
+        .tracePath = NULL,
+        .worldPath = NULL,
+        .threadCount = 0,
+        .renderThread = true,
+        .windowScale = WINDOW_SCALE,
+        .renderBackend = RENDER_BACKEND_AUTO
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            options.headless = true;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            options.frameLimit = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--tickrate") == 0 && i + 1 < argc)
+        {
+            options.tickRate = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--vsync") == 0)
+        {
+            options.vsync = true;
+        }
+        else if (strcmp(argv[i], "--frame-report") == 0)
+        {
+            options.frameReport = true;
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            options.seed = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            options.recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            options.replayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            options.tracePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--world") == 0 && i + 1 < argc)
+        {
+            options.worldPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            options.threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-render-thread") == 0)
+        {
+            options.renderThread = false;
+        }
+        else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+        {
+            options.windowScale = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc
+            && Render_ParseBackend(argv[i + 1], &options.renderBackend))
+        {
+            i += 1;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Game_Init(&options);
     Game_run();
     return 0;
 }
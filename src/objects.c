@@ -26,74 +26,96 @@ typedef enum {
     DIRECTION_XY = DIRECTION_X | DIRECTION_Y
 } Direction;
 
-typedef enum {
-    HITTEST_NONE = 0,
-    HITTEST_WALLS = 1,
-    HITTEST_FLOOR = 2,
-    HITTEST_LEVEL = 4,
-    HITTEST_ALL = HITTEST_WALLS | HITTEST_FLOOR | HITTEST_LEVEL
-} HitTest;
+static bool moveTest(void* context, int r, int c, int side)
+{
+    const int hitTest = *(const int*)context;
+    const bool alongX = side == SOLID_LEFT || side == SOLID_RIGHT;
+
+    if (hitTest & HITTEST_LEVEL)
+    {
+        if (alongX ? (c < 0 || c >= level->columnCount) : (r < 0 || r >= level->rowCount))
+        {
+            return true;
+        }
+    }
+
+    if ((hitTest & HITTEST_WALLS) && Util_IsSolid(r, c, side))
+    {
+        return true;
+    }
+
+    // Do not step off the edge
+    if ((hitTest & HITTEST_FLOOR) && alongX && !Util_IsSolid(r + 1, c, SOLID_TOP) && !Util_IsLadder(r + 1, c))
+    {
+        return true;
+    }
+
+    return false;
+}
 
 // Moves the object and checks the walls, floor and level borders according
 // to hitTest flags. Returns 0 on success, otherwise returns the directions
-// which the object could not fully move to.
+// which the object could not fully move to. The object is swept through the
+// cells, so it can not skip a wall at any speed.
 static int move(Object* object, int hitTest)
 {
-    const double dt = FrameControl_GetElapsedFrameTime() / 1000.0;
-    const double dx = Util_LimitAbs(object->vx, MAX_SPEED) * dt;
-    const double dy = Util_LimitAbs(object->vy, MAX_SPEED) * dt;
-
-    const int check_walls = hitTest & HITTEST_WALLS;
-    const int check_floor = hitTest & HITTEST_FLOOR;
-    const int check_level = hitTest & HITTEST_LEVEL;
+    const Scalar dt = FrameControl_GetDeltaTime();
+    const Scalar dx = Scalar_Mul(object->vx, dt);
+    const Scalar dy = Scalar_Mul(object->vy, dt);
 
     const SDL_Rect bodyRect = object->type->body;
 
     int result = 0;
     int r, c;
     Borders cell, body;
-    Util_GetObjectPos(object, &r, &c, &cell, &body);
+    SweepHit hit;
 
+    // ... X, across the row of the center
+    Util_GetObjectPos(object, &r, &c, &cell, &body);
     object->x += dx;
-    object->y += dy;
-    Util_GetObjectBody(object, &body);
 
-    if (dx > 0 && body.right > cell.right)
+    if (dx != 0)
     {
-        if ((check_walls && Util_IsSolid(r, c + 1, SOLID_LEFT))
-        || (check_level && body.right > LEVEL_WIDTH)
-        || (check_floor && !Util_IsSolid(r + 1, c + 1, SOLID_TOP) && !Util_IsLadder(r + 1, c + 1)))
-        {
-            object->x = cell.right - (bodyRect.x + bodyRect.w);
-            result |= DIRECTION_X;
-        }
-    }
-    else if (dx < 0 && body.left < cell.left)
-    {
-        if ((check_walls && Util_IsSolid(r, c - 1, SOLID_RIGHT))
-        || (check_level && body.left < 0)
-        || (check_floor && !Util_IsSolid(r + 1, c - 1, SOLID_TOP) && !Util_IsLadder(r + 1, c - 1)))
+        const Borders start = body;
+        Util_GetObjectBody(object, &body);
+
+        const Sweep sweep = {
+            .side = dx > 0 ? SOLID_LEFT : SOLID_RIGHT,
+            .edge = dx > 0 ? start.right : start.left,
+            .end = dx > 0 ? body.right : body.left,
+            .cell = c,
+            .laneFirst = r,
+            .laneLast = r
+        };
+
+        if (Util_Sweep(&sweep, moveTest, &hitTest, &hit))
         {
-            object->x = cell.left - bodyRect.x;
+            object->x = Scalar_FromDouble(dx > 0 ? hit.edge - (bodyRect.x + bodyRect.w) : hit.edge - bodyRect.x);
             result |= DIRECTION_X;
         }
     }
 
-    if (dy > 0 && body.bottom > cell.bottom)
-    {
-        if ((check_walls && Util_IsSolid(r + 1, c, SOLID_TOP))
-        || (check_level && body.bottom > LEVEL_HEIGHT))
-        {
-            object->y = cell.bottom - (bodyRect.y + bodyRect.h);
-            result |= DIRECTION_Y;
-        }
-    }
-    else if (dy < 0 && body.top < cell.top)
+    // ... Y, across the column of the center after moving by X
+    Util_GetObjectPos(object, &r, &c, &cell, &body);
+    object->y += dy;
+
+    if (dy != 0)
     {
-        if ((check_walls && Util_IsSolid(r - 1, c, SOLID_BOTTOM))
-        || (check_level && body.top < 0))
+        const Borders start = body;
+        Util_GetObjectBody(object, &body);
+
+        const Sweep sweep = {
+            .side = dy > 0 ? SOLID_TOP : SOLID_BOTTOM,
+            .edge = dy > 0 ? start.bottom : start.top,
+            .end = dy > 0 ? body.bottom : body.top,
+            .cell = r,
+            .laneFirst = c,
+            .laneLast = c
+        };
+
+        if (Util_Sweep(&sweep, moveTest, &hitTest, &hit))
         {
-            object->y = cell.top - bodyRect.y;
+            object->y = Scalar_FromDouble(dy > 0 ? hit.edge - (bodyRect.y + bodyRect.h) : hit.edge - bodyRect.y);
             result |= DIRECTION_Y;
         }
     }
@@ -101,7 +123,7 @@ static int move(Object* object, int hitTest)
     return result;
 }
 
-static void setSpeed(Object* object, double vx, double vy)
+static void setSpeed(Object* object, Scalar vx, Scalar vy)
 {
     object->vx = vx;
     object->vy = vy;
@@ -109,35 +131,35 @@ static void setSpeed(Object* object, double vx, double vy)
 }
 
 // Returns animation speed (frames per second) for the movement speed (pixels per second)
-static inline int speedToFps(double speed)
+static inline int speedToFps(Scalar speed)
 {
-    return ceil(fabs(speed / 12.0));
+    return ceil(fabs(Scalar_ToDouble(speed) / 12.0));
 }
 
 // Returns 1 if the source sees the target
 static bool isVisible(Object* source, Object* target)
 {
-    if ((target->y + CELL_SIZE > source->y + CELL_HALF)
-     && (target->y < source->y + CELL_HALF))
+    if ((target->y + SCALAR(CELL_SIZE) > source->y + SCALAR(CELL_HALF))
+     && (target->y < source->y + SCALAR(CELL_HALF)))
     {
         int x1, x2;
 
         if (target->x < source->x && (source->anim.flip & SDL_FLIP_HORIZONTAL))
         {
-            x1 = target->x;
-            x2 = source->x;
+            x1 = Scalar_ToInt(target->x);
+            x2 = Scalar_ToInt(source->x);
         }
         else if (target->x > source->x && !(source->anim.flip & SDL_FLIP_HORIZONTAL))
         {
-            x1 = source->x;
-            x2 = target->x;
+            x1 = Scalar_ToInt(source->x);
+            x2 = Scalar_ToInt(target->x);
         }
         else
         {
             return false;
         }
 
-        const int r = (source->y + CELL_HALF) / CELL_SIZE;
+        const int r = (Scalar_ToDouble(source->y) + CELL_HALF) / CELL_SIZE;
         for (x1 = x1 + CELL_HALF; x1 < x2; x1 += CELL_SIZE)
         {
             const int c = x1 / CELL_SIZE;
@@ -153,6 +175,16 @@ static bool isVisible(Object* source, Object* target)
     return false;
 }
 
+int Object_Move(Object* object, int hitTest)
+{
+    return move(object, hitTest);
+}
+
+bool Object_IsVisible(Object* source, Object* target)
+{
+    return isVisible(source, target);
+}
+
 
 // Logic
 
@@ -184,9 +216,9 @@ static const int ENEMY_WAITING = 12000;
 
 void MovingEnemy_onInit(Object* e)
 {
-    const int dir = rand() % 2 ? 1 : -1;
+    const int dir = Util_Random() % 2 ? 1 : -1;
     setSpeed(e, e->type->speed * dir, 0);
-    e->state = -rand() % ENEMY_MOVING;
+    e->state = -Util_Random() % ENEMY_MOVING;
 }
 
 void MovingEnemy_onFrame(Object* e)
@@ -207,8 +239,8 @@ void MovingEnemy_onFrame(Object* e)
     }
     else
     {
-        e->state = ENEMY_MOVING - rand() % (ENEMY_MOVING * 2);
-        if (rand() % 2)
+        e->state = ENEMY_MOVING - Util_Random() % (ENEMY_MOVING * 2);
+        if (Util_Random() % 2)
         {
             setSpeed(e, -e->vx, e->vy);
         }
@@ -244,10 +276,10 @@ void ShootingEnemy_onFrame(Object* e)
     {
         if (isVisible(e, (Object*)&player))
         {
-            Object* shot = Types_CreateObject(level, TYPE_ICESHOT, 0, 0);
+            Object* shot = Game_SpawnObject(TYPE_ICESHOT);
             shot->x = (e->anim.flip & SDL_FLIP_HORIZONTAL)
-                ? e->x - shot->type->sprite.w
-                : e->x + e->type->sprite.w;
+                ? e->x - Scalar_FromInt(shot->type->sprite.w)
+                : e->x + Scalar_FromInt(e->type->sprite.w);
             shot->y = e->y;
             setSpeed(shot, shot->vx * (e->vx > 0 ? 1 : -1), shot->vy);
             e->state = SHOOTINGENEMY_MOVING + 1;
@@ -321,7 +353,7 @@ void Bat_onInit(Object* e)
 {
     MovingEnemy_onInit(e);
     Render_SetAnimation(e, 0, 1, speedToFps(e->vx));
-    setSpeed(e, e->vx, e->type->speed / 2.0);
+    setSpeed(e, e->vx, e->type->speed / 2);
     e->state = 0;
 }
 
@@ -363,7 +395,7 @@ void Bat_onHit(Object* e)
 
 static const int ITEM_IDLE = 0;
 static const int ITEM_TAKEN = 1;
-static const double ITEM_FADE_SPEED = 0.25; // Seconds
+static const Scalar ITEM_FADE_SPEED = SCALAR(0.25); // Seconds
 
 void Item_onHit(Object* item)
 {
@@ -393,7 +425,7 @@ void Item_onHit(Object* item)
         }
 
         item->state = ITEM_IDLE + 1;
-        setSpeed(item, item->vx, -7 * 24);
+        setSpeed(item, item->vx, SCALAR(-7 * 24));
         Render_SetAnimation(item, 0, 0, 0);
     }
 }
@@ -406,14 +438,14 @@ void Item_onFrame(Object* item)
     }
     else if (item->state <= ITEM_TAKEN)
     {
-        const double dt = FrameControl_GetElapsedFrameTime() / 1000.0;
-        item->anim.alpha -= (255 / ITEM_FADE_SPEED) * dt;
+        const Scalar dt = FrameControl_GetDeltaTime();
+        item->anim.alpha -= (255 / Scalar_ToDouble(ITEM_FADE_SPEED)) * Scalar_ToDouble(dt);
         if (item->anim.alpha < 0)
         {
             item->anim.alpha = 0;
             item->state = ITEM_TAKEN + 1;
         }
-        setSpeed(item, item->vx, item->vy - item->vy * dt / ITEM_FADE_SPEED);
+        setSpeed(item, item->vx, item->vy - Scalar_Div(Scalar_Mul(item->vy, dt), ITEM_FADE_SPEED));
         move(item, HITTEST_NONE);
     }
     else
@@ -439,9 +471,11 @@ void Fireball_onFrame(Object* e)
     {
         if (isVisible(e, (Object*)&player))
         {
-            Object* shot = Types_CreateObject(level, TYPE_FIRESHOT, 0, 0);
-            shot->x = e->anim.flip & SDL_FLIP_HORIZONTAL ? e->x - shot->type->sprite.w : e->x + e->type->sprite.w;
-            shot->y = e->y + 2;
+            Object* shot = Game_SpawnObject(TYPE_FIRESHOT);
+            shot->x = e->anim.flip & SDL_FLIP_HORIZONTAL
+                ? e->x - Scalar_FromInt(shot->type->sprite.w)
+                : e->x + Scalar_FromInt(e->type->sprite.w);
+            shot->y = e->y + SCALAR(2);
             setSpeed(shot, shot->vx * (e->vx > 0 ? 1 : -1), shot->vy);
             e->state = FIREBALL_MOVING + 1;
         }
@@ -470,11 +504,11 @@ void Fireball_onFrame(Object* e)
     e->data -= dt;
     if (e->data < 0)
     {
-        if (rand() % 10 == 9)
+        if (Util_Random() % 10 == 9)
         {
             setSpeed(e, -e->vx, e->vy);
         }
-        if (rand() % 10 == 9)
+        if (Util_Random() % 10 == 9)
         {
             setSpeed(e, e->vx, -e->vy);
         }
@@ -495,7 +529,7 @@ static const int DROP_FELL = 5000;
 
 void Drop_onInit(Object* e)
 {
-    e->state = -rand() % 2000;
+    e->state = -Util_Random() % 2000;
 }
 
 void Drop_onFrame(Object* e)
@@ -510,17 +544,17 @@ void Drop_onFrame(Object* e)
     }
     else if (e->state <= DROP_CREATE)
     {
-        Object* drop = Types_CreateObject(level, TYPE_DROP, 0, 0);
+        Object* drop = Game_SpawnObject(TYPE_DROP);
         drop->x = e->x;
         drop->y = e->y;
         drop->state = DROP_FALLING;
-        e->state = DROP_WAITING - 2000 - rand() % 8000;
+        e->state = DROP_WAITING - 2000 - Util_Random() % 8000;
     }
     else if (e->state <= DROP_FALLING)
     {
-        if (e->vy < 120)
+        if (e->vy < SCALAR(120))
         {
-            e->vy += 48 * FrameControl_GetElapsedFrameTime() / 1000.0;
+            e->vy += 48 * FrameControl_GetDeltaTime();
         }
         if (move(e, HITTEST_WALLS | HITTEST_LEVEL))
         {
@@ -558,12 +592,12 @@ void Spider_onFrame(Object* e)
 {
     MovingEnemy_onFrame(e);
 
-    if (rand() % 100 == 99)
+    if (Util_Random() % 100 == 99)
     {
         const int direction = e->vx > 0 ? 1 : -1;
-        if (fabs(e->vx) == e->type->speed)
+        if (Scalar_Abs(e->vx) == e->type->speed)
         {
-            setSpeed(e, direction * e->type->speed * 2.5, e->vy);
+            setSpeed(e, Scalar_Mul(direction * e->type->speed, SCALAR(2.5)), e->vy);
         }
         else
         {
@@ -602,11 +636,11 @@ void TeleportingEnemy_onFrame(Object* e)
     }
     else if (e->state <= TELEPORTINGENEMY_TELEPORT)
     {
-        const int currentRow = (e->y + CELL_HALF) / CELL_SIZE;
-        for (int i = 0; i < CELL_COUNT; i++)
+        const int currentRow = (Scalar_ToDouble(e->y) + CELL_HALF) / CELL_SIZE;
+        for (int i = 0; i < level->rowCount * level->columnCount; i++)
         {
-            const int r = rand() % (ROW_COUNT - 1);
-            const int c = rand() % COLUMN_COUNT;
+            const int r = Util_Random() % (level->rowCount - 1);
+            const int c = Util_Random() % level->columnCount;
             if (r == currentRow)
             {
                 continue;
@@ -616,8 +650,8 @@ void TeleportingEnemy_onFrame(Object* e)
             const bool canMoveRight = !Util_IsSolid(r, c + 1, SOLID_LEFT)  && Util_IsSolid(r + 1, c + 1, SOLID_TOP);
             if (canStand && (canMoveLeft || canMoveRight))
             {
-                e->y = CELL_SIZE * r;
-                e->x = CELL_SIZE * c;
+                e->y = Scalar_FromInt(CELL_SIZE * r);
+                e->x = Scalar_FromInt(CELL_SIZE * c);
                 break;
             }
         }
@@ -637,7 +671,7 @@ void TeleportingEnemy_onFrame(Object* e)
     }
     else
     {
-        e->state = -rand() % 2000;
+        e->state = -Util_Random() % 2000;
         e->anim.alpha = 255;
     }
 
@@ -669,7 +703,7 @@ void Platform_onFrame(Object* e)
 
 void Platform_onHit(Object* e)
 {
-    const double dt = FrameControl_GetElapsedFrameTime() / 1000.0;
+    const Scalar dt = FrameControl_GetDeltaTime();
     const double dw = (CELL_SIZE - player.type->body.w) / 2.0;
     const double dh = (CELL_SIZE - player.type->body.h) / 2.0;
     const double border = 3;
@@ -686,25 +720,25 @@ void Platform_onHit(Object* e)
     {
         if (!player.vx)
         {
-            player.x += e->vx * dt;
+            player.x += Scalar_Mul(e->vx, dt);
         }
-        player.y = eb.top - dh - player.type->body.h;
+        player.y = Scalar_FromDouble(eb.top - dh - player.type->body.h);
         player.inAir = false;
     }
     // Bottom
     else if (pb.top < eb.bottom && pb.top > eb.top && hitX)
     {
-        player.y = eb.bottom - dh;
+        player.y = Scalar_FromDouble(eb.bottom - dh);
     }
     // Left
     else if (pb.right > eb.left && pb.right < eb.right && hitY)
     {
-        player.x = eb.left - dw - player.type->body.w;
+        player.x = Scalar_FromDouble(eb.left - dw - player.type->body.w);
     }
     // Right
     else if (pb.left < eb.right && pb.left > eb.left && hitY)
     {
-        player.x = eb.right - dw;
+        player.x = Scalar_FromDouble(eb.right - dw);
     }
 }
 
@@ -728,9 +762,9 @@ void Spring_onFrame(Object* e)
 
 void Spring_onHit(Object* e)
 {
-    if (e->state == 0 && player.vy > 48)
+    if (e->state == 0 && player.vy > SCALAR(48))
     {
-        player.vy = -15 * 24;
+        player.vy = SCALAR(-15 * 24);
         e->state = 1000;
         Render_SetAnimation(e, 1, 1, 0);
     }
@@ -739,11 +773,11 @@ void Spring_onHit(Object* e)
 
 void Cloud_onHit(Object* e)
 {
-    if (player.y + CELL_HALF < e->y + CELL_SIZE)
+    if (player.y + SCALAR(CELL_HALF) < e->y + SCALAR(CELL_SIZE))
     {
         if (player.vy > 0)
         {
-            player.y -= player.vy * 0.9 * FrameControl_GetElapsedFrameTime() / 1000.0;
+            player.y -= Scalar_Mul(Scalar_Mul(player.vy, SCALAR(0.9)), FrameControl_GetDeltaTime());
         }
         player.inAir = false;
     }
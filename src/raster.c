@@ -0,0 +1,528 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#include "raster.h"
+#include "jobs.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const uint32_t ALPHA_MASK = 0xFF000000u;
+
+bool Raster_CreateImage(RasterImage* image, int width, int height)
+{
+    image->pixels = (uint32_t*)calloc((size_t)width * height, sizeof(uint32_t));
+    image->width = image->pixels ? width : 0;
+    image->height = image->pixels ? height : 0;
+    return image->pixels != NULL;
+}
+
+bool Raster_CreateImageFromSurface(RasterImage* image, SDL_Surface* surface)
+{
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (converted == NULL)
+    {
+        return false;
+    }
+
+    if (!Raster_CreateImage(image, converted->w, converted->h))
+    {
+        SDL_FreeSurface(converted);
+        return false;
+    }
+
+    // The conversion may or may not turn the colour key into alpha, so it is
+    // done here by the key colour
+    Uint32 key;
+    const bool keyed = SDL_GetColorKey(surface, &key) == 0;
+    uint32_t keyColor = 0;
+    if (keyed)
+    {
+        Uint8 r, g, b;
+        SDL_GetRGB(key, surface->format, &r, &g, &b);
+        keyColor = (uint32_t)r << 16 | (uint32_t)g << 8 | b;
+    }
+
+    SDL_LockSurface(converted);
+
+    for (int y = 0; y < converted->h; y++)
+    {
+        const uint32_t* row = (const uint32_t*)((const uint8_t*)converted->pixels + y * converted->pitch);
+        uint32_t* pixels = &image->pixels[y * image->width];
+
+        for (int x = 0; x < converted->w; x++)
+        {
+            const uint32_t color = row[x] & ~ALPHA_MASK;
+
+            if (keyed)
+            {
+                pixels[x] = color == keyColor ? color : (color | ALPHA_MASK);
+            }
+            else
+            {
+                pixels[x] = row[x];
+            }
+        }
+    }
+
+    SDL_UnlockSurface(converted);
+    SDL_FreeSurface(converted);
+    return true;
+}
+
+void Raster_FreeImage(RasterImage* image)
+{
+    free(image->pixels);
+    image->pixels = NULL;
+    image->width = 0;
+    image->height = 0;
+}
+
+void Raster_FillRect(RasterImage* target, SDL_Rect rect, SDL_Color color)
+{
+    const SDL_Rect bounds = {0, 0, target->width, target->height};
+    if (!SDL_IntersectRect(&rect, &bounds, &rect))
+    {
+        return;
+    }
+
+    const uint32_t pixel = (uint32_t)color.a << 24 | (uint32_t)color.r << 16 | (uint32_t)color.g << 8 | color.b;
+
+    for (int y = rect.y; y < rect.y + rect.h; y++)
+    {
+        uint32_t* row = &target->pixels[y * target->width + rect.x];
+
+        for (int x = 0; x < rect.w; x++)
+        {
+            row[x] = pixel;
+        }
+    }
+}
+
+void Raster_Copy(RasterImage* target, const RasterImage* source, int x, int y)
+{
+    SDL_Rect rect = {x, y, source->width, source->height};
+    const SDL_Rect bounds = {0, 0, target->width, target->height};
+    if (!SDL_IntersectRect(&rect, &bounds, &rect))
+    {
+        return;
+    }
+
+    for (int row = rect.y; row < rect.y + rect.h; row++)
+    {
+        memcpy(&target->pixels[row * target->width + rect.x],
+            &source->pixels[(row - y) * source->width + rect.x - x],
+            (size_t)rect.w * sizeof(uint32_t));
+    }
+}
+
+// Pixel of a source row, which is read backwards if it is flipped
+static inline uint32_t Raster_Source(const uint32_t* source, int i, int count, bool flip)
+{
+    return flip ? source[count - 1 - i] : source[i];
+}
+
+// (source * alpha + target * (255 - alpha)) / 255 of a channel, rounded
+static inline uint32_t Raster_BlendChannel(uint32_t source, uint32_t target, uint32_t alpha)
+{
+    const uint32_t value = source * alpha + target * (255 - alpha) + 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+#if defined(__AVX2__)
+static inline __m256i Raster_Load8(const uint32_t* source, int i, int count, bool flip)
+{
+    if (!flip)
+    {
+        return _mm256_loadu_si256((const __m256i*)(source + i));
+    }
+
+    const __m256i pixels = _mm256_loadu_si256((const __m256i*)(source + count - i - 8));
+    return _mm256_permutevar8x32_epi32(pixels, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+// The 16 bit channels of a half of the pixels blended, see Raster_BlendChannel()
+static inline __m256i Raster_Blend16x16(__m256i source, __m256i target, __m256i alpha, __m256i inverse)
+{
+    __m256i value = _mm256_add_epi16(_mm256_mullo_epi16(source, alpha), _mm256_mullo_epi16(target, inverse));
+    value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+}
+#endif
+
+#if defined(__SSE2__)
+static inline __m128i Raster_Load4(const uint32_t* source, int i, int count, bool flip)
+{
+    if (!flip)
+    {
+        return _mm_loadu_si128((const __m128i*)(source + i));
+    }
+
+    const __m128i pixels = _mm_loadu_si128((const __m128i*)(source + count - i - 4));
+    return _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+static inline __m128i Raster_Blend8x16(__m128i source, __m128i target, __m128i alpha, __m128i inverse)
+{
+    __m128i value = _mm_add_epi16(_mm_mullo_epi16(source, alpha), _mm_mullo_epi16(target, inverse));
+    value = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+#endif
+
+// Copies the opaque source pixels of a row
+static void Raster_BlitRow(uint32_t* target, const uint32_t* source, int count, bool flip)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i alphaMask8 = _mm256_set1_epi32((int)ALPHA_MASK);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i s = Raster_Load8(source, i, count, flip);
+        const __m256i t = _mm256_loadu_si256((const __m256i*)(target + i));
+        const __m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask8), _mm256_setzero_si256());
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_blendv_epi8(s, t, transparent));
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i alphaMask4 = _mm_set1_epi32((int)ALPHA_MASK);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i s = Raster_Load4(source, i, count, flip);
+        const __m128i t = _mm_loadu_si128((const __m128i*)(target + i));
+        const __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask4), _mm_setzero_si128());
+        _mm_storeu_si128((__m128i*)(target + i),
+            _mm_or_si128(_mm_andnot_si128(transparent, s), _mm_and_si128(transparent, t)));
+    }
+#endif
+
+    // The rest, or all without SIMD
+    for (; i < count; i++)
+    {
+        const uint32_t s = Raster_Source(source, i, count, flip);
+        if (s & ALPHA_MASK)
+        {
+            target[i] = s;
+        }
+    }
+}
+
+// Blends the opaque source pixels of a row with the target by alpha
+static void Raster_BlendRow(uint32_t* target, const uint32_t* source, int count, bool flip, int alpha)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i alphaMask8 = _mm256_set1_epi32((int)ALPHA_MASK);
+    const __m256i alpha8 = _mm256_set1_epi16((short)alpha);
+    const __m256i inverse8 = _mm256_set1_epi16((short)(255 - alpha));
+    const __m256i zero8 = _mm256_setzero_si256();
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i s = Raster_Load8(source, i, count, flip);
+        const __m256i t = _mm256_loadu_si256((const __m256i*)(target + i));
+        const __m256i low = Raster_Blend16x16(
+            _mm256_unpacklo_epi8(s, zero8), _mm256_unpacklo_epi8(t, zero8), alpha8, inverse8);
+        const __m256i high = Raster_Blend16x16(
+            _mm256_unpackhi_epi8(s, zero8), _mm256_unpackhi_epi8(t, zero8), alpha8, inverse8);
+        const __m256i blended = _mm256_or_si256(_mm256_packus_epi16(low, high), alphaMask8);
+        const __m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask8), zero8);
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_blendv_epi8(blended, t, transparent));
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i alphaMask4 = _mm_set1_epi32((int)ALPHA_MASK);
+    const __m128i alpha4 = _mm_set1_epi16((short)alpha);
+    const __m128i inverse4 = _mm_set1_epi16((short)(255 - alpha));
+    const __m128i zero4 = _mm_setzero_si128();
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i s = Raster_Load4(source, i, count, flip);
+        const __m128i t = _mm_loadu_si128((const __m128i*)(target + i));
+        const __m128i low = Raster_Blend8x16(
+            _mm_unpacklo_epi8(s, zero4), _mm_unpacklo_epi8(t, zero4), alpha4, inverse4);
+        const __m128i high = Raster_Blend8x16(
+            _mm_unpackhi_epi8(s, zero4), _mm_unpackhi_epi8(t, zero4), alpha4, inverse4);
+        const __m128i blended = _mm_or_si128(_mm_packus_epi16(low, high), alphaMask4);
+        const __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask4), zero4);
+        _mm_storeu_si128((__m128i*)(target + i),
+            _mm_or_si128(_mm_andnot_si128(transparent, blended), _mm_and_si128(transparent, t)));
+    }
+#endif
+
+    // The rest, or all without SIMD
+    for (; i < count; i++)
+    {
+        const uint32_t s = Raster_Source(source, i, count, flip);
+        if (s & ALPHA_MASK)
+        {
+            const uint32_t t = target[i];
+            target[i] = ALPHA_MASK
+                | Raster_BlendChannel((s >> 16) & 0xFF, (t >> 16) & 0xFF, alpha) << 16
+                | Raster_BlendChannel((s >> 8) & 0xFF, (t >> 8) & 0xFF, alpha) << 8
+                | Raster_BlendChannel(s & 0xFF, t & 0xFF, alpha);
+        }
+    }
+}
+
+// The part of the source rect outside the source image is not drawn, the
+// part outside the target is clipped.
+void Raster_Blit(RasterImage* target, const RasterImage* source, SDL_Rect sourceRect,
+                 int x, int y, SDL_RendererFlip flip, int alpha)
+{
+    const int w = sourceRect.w;
+    const int h = sourceRect.h;
+
+    if (alpha <= 0 || w <= 0 || h <= 0 || sourceRect.x < 0 || sourceRect.y < 0
+        || sourceRect.x + w > source->width || sourceRect.y + h > source->height)
+    {
+        return;
+    }
+
+    // Clipped columns and rows of the target
+    const int left = x < 0 ? -x : 0;
+    const int top = y < 0 ? -y : 0;
+    const int right = x + w > target->width ? x + w - target->width : 0;
+    const int bottom = y + h > target->height ? y + h - target->height : 0;
+
+    if (left + right >= w || top + bottom >= h)
+    {
+        return;
+    }
+
+    // With a flip the clipped columns and rows are on the other side of the source
+    const bool flipX = flip & SDL_FLIP_HORIZONTAL;
+    const bool flipY = flip & SDL_FLIP_VERTICAL;
+    const int sourceX = sourceRect.x + (flipX ? right : left);
+    const int count = w - left - right;
+
+    for (int row = top; row < h - bottom; row++)
+    {
+        const int sourceRow = sourceRect.y + (flipY ? h - 1 - row : row);
+        const uint32_t* sourcePixels = &source->pixels[sourceRow * source->width + sourceX];
+        uint32_t* targetPixels = &target->pixels[(y + row) * target->width + x + left];
+
+        if (alpha >= 255)
+        {
+            Raster_BlitRow(targetPixels, sourcePixels, count, flipX);
+        }
+        else
+        {
+            Raster_BlendRow(targetPixels, sourcePixels, count, flipX, alpha);
+        }
+    }
+}
+
+const char* Raster_GetKernelName()
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+void Raster_InitCommands(RasterCommandList* list)
+{
+    memset(list, 0, sizeof(*list));
+}
+
+void Raster_FreeCommands(RasterCommandList* list)
+{
+    for (int i = 0; i < RASTER_BAND_MAX; i++)
+    {
+        free(list->bins[i].commands);
+    }
+
+    free(list->commands);
+    memset(list, 0, sizeof(*list));
+}
+
+// Returns NULL if there is no memory, then the command is not drawn
+static RasterCommand* Raster_AddCommand(RasterCommandList* list, RasterCommandType type)
+{
+    if (list->count == list->reserved)
+    {
+        const int reserved = list->reserved ? list->reserved * 2 : 256;
+        RasterCommand* commands = (RasterCommand*)realloc(list->commands, reserved * sizeof(RasterCommand));
+        if (commands == NULL)
+        {
+            return NULL;
+        }
+
+        list->commands = commands;
+        list->reserved = reserved;
+    }
+
+    RasterCommand* command = &list->commands[list->count++];
+    memset(command, 0, sizeof(*command));
+    command->type = type;
+    return command;
+}
+
+void Raster_AddBlit(RasterCommandList* list, const RasterImage* source, SDL_Rect sourceRect,
+                    int x, int y, SDL_RendererFlip flip, int alpha)
+{
+    RasterCommand* command = Raster_AddCommand(list, RASTER_COMMAND_BLIT);
+    if (command)
+    {
+        command->source = source;
+        command->rect = sourceRect;
+        command->x = x;
+        command->y = y;
+        command->flip = flip;
+        command->alpha = alpha;
+    }
+}
+
+void Raster_AddFill(RasterCommandList* list, SDL_Rect rect, SDL_Color color)
+{
+    RasterCommand* command = Raster_AddCommand(list, RASTER_COMMAND_FILL);
+    if (command)
+    {
+        command->rect = rect;
+        command->color = color;
+    }
+}
+
+void Raster_AddCopy(RasterCommandList* list, const RasterImage* source, int x, int y)
+{
+    RasterCommand* command = Raster_AddCommand(list, RASTER_COMMAND_COPY);
+    if (command)
+    {
+        command->source = source;
+        command->rect = (SDL_Rect) {0, 0, source->width, source->height};
+        command->x = x;
+        command->y = y;
+    }
+}
+
+static bool Raster_AddToBin(RasterBin* bin, int command)
+{
+    if (bin->count == bin->reserved)
+    {
+        const int reserved = bin->reserved ? bin->reserved * 2 : 64;
+        int* commands = (int*)realloc(bin->commands, reserved * sizeof(int));
+        if (commands == NULL)
+        {
+            return false;
+        }
+
+        bin->commands = commands;
+        bin->reserved = reserved;
+    }
+
+    bin->commands[bin->count++] = command;
+    return true;
+}
+
+typedef struct {
+    RasterCommandList* list;
+    RasterImage* target;
+    int bandHeight;
+} RasterExecution;
+
+// Executes the commands of a band on the band rows only, as on an image that
+// begins at the band top
+static void Raster_ExecuteBand(void* context, int band)
+{
+    const RasterExecution* execution = (const RasterExecution*)context;
+    const RasterBin* bin = &execution->list->bins[band];
+    RasterImage* target = execution->target;
+
+    const int top = band * execution->bandHeight;
+    const int height = top + execution->bandHeight < target->height ? execution->bandHeight : target->height - top;
+    RasterImage view = {target->pixels + top * target->width, target->width, height};
+
+    TRACE_BEGIN_ARG("Raster_ExecuteBand", band);
+
+    for (int i = 0; i < bin->count; i++)
+    {
+        const RasterCommand* command = &execution->list->commands[bin->commands[i]];
+
+        switch (command->type)
+        {
+            case RASTER_COMMAND_BLIT:
+                Raster_Blit(&view, command->source, command->rect,
+                    command->x, command->y - top, command->flip, command->alpha);
+                break;
+
+            case RASTER_COMMAND_FILL:
+            {
+                SDL_Rect rect = command->rect;
+                rect.y -= top;
+                Raster_FillRect(&view, rect, command->color);
+                break;
+            }
+
+            case RASTER_COMMAND_COPY:
+                Raster_Copy(&view, command->source, command->x, command->y - top);
+                break;
+        }
+    }
+
+    TRACE_END();
+}
+
+void Raster_ExecuteCommands(RasterCommandList* list, RasterImage* target, int bandHeight)
+{
+    if (bandHeight * RASTER_BAND_MAX < target->height)
+    {
+        bandHeight = (target->height + RASTER_BAND_MAX - 1) / RASTER_BAND_MAX;
+    }
+    if (bandHeight <= 0)
+    {
+        bandHeight = target->height;
+    }
+
+    const int bandCount = target->height > 0 ? (target->height + bandHeight - 1) / bandHeight : 0;
+
+    for (int band = 0; band < bandCount; band++)
+    {
+        list->bins[band].count = 0;
+    }
+
+    // Bin the commands by their rows
+    for (int i = 0; i < list->count; i++)
+    {
+        const RasterCommand* command = &list->commands[i];
+        const int top = command->type == RASTER_COMMAND_FILL ? command->rect.y : command->y;
+        const int bottom = top + command->rect.h;   // Exclusive
+
+        if (command->rect.w <= 0 || bottom <= 0 || top >= target->height)
+        {
+            continue;
+        }
+
+        const int first = top > 0 ? top / bandHeight : 0;
+        const int last = bottom < target->height ? (bottom - 1) / bandHeight : bandCount - 1;
+
+        for (int band = first; band <= last; band++)
+        {
+            Raster_AddToBin(&list->bins[band], i);
+        }
+    }
+
+    RasterExecution execution = {list, target, bandHeight};
+    Jobs_Run(Raster_ExecuteBand, &execution, bandCount);
+
+    list->count = 0;
+}
@@ -8,14 +8,17 @@
 #include "game.h"
 #include "framecontrol.h"
 #include "helpers.h"
+#include "raster.h"
+#include "trace.h"
 #include "types.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
-SDL_Renderer* renderer;
+static SDL_Renderer* renderer;
 static SDL_Texture* sprites;
 static SDL_Window* window;
 static SDL_Texture* messages[MESSAGE_COUNT];
@@ -23,136 +26,444 @@ static SDL_Texture* messages[MESSAGE_COUNT];
 static const SDL_Color TEXT_COLOR = {255, 255, 255, 255};
 static const SDL_Color TEXT_BOX_CONTENT_COLOR = {0, 0, 0, 255};
 static const SDL_Color TEXT_BOX_BORDER_COLOR = {255, 255, 255, 255};
-static const int TEXT_BOX_BORDER = 1 * SIZE_FACTOR;
-static const int TEXT_BOX_PADDING = 5 * SIZE_FACTOR;
-static const int TEXT_FONT_SIZE = 8 * SIZE_FACTOR;
+static const int TEXT_BOX_BORDER = 1;
+static const int TEXT_BOX_PADDING = 5;
+static const int TEXT_FONT_SIZE = 8;
+static const double INTERPOLATION_MAX_DISTANCE = CELL_SIZE * 2;
+
+// The screen shows a view of the level that follows the player, and only the
+// cells and objects in the view are captured and drawn, so a frame costs the
+// same in a level of any size. A view not aligned to the cells shows parts of
+// one more row and column.
+enum {
+    VIEW_ROW_COUNT = SCREEN_ROW_COUNT + 1,
+    VIEW_COLUMN_COUNT = SCREEN_COLUMN_COUNT + 1
+};
+
+// The objects are captured in the view extended by the largest sprite size
+static const int VIEW_MARGIN = CELL_SIZE;
+
+// The sprites are not drawn one by one, but collected into the batch and then
+// drawn all at once by Render_FlushSprites(). Each sprite is a quad, its alpha
+// and flip are set by the vertex colors and texture coordinates, so the batch
+// does not change the texture state.
+enum { SPRITE_BATCH_SIZE = 1024 }; // Sprites
+
+static struct {
+    SDL_Vertex vertices[SPRITE_BATCH_SIZE * 4];
+    int indices[SPRITE_BATCH_SIZE * 6];
+    int count;
+    float textureWidth;
+    float textureHeight;
+} batch;
+
+// Object as it is drawn in a frame
+typedef struct {
+    SDL_Rect sprite;
+    int x;                  // In the view, between the previous and the current logic steps
+    int y;                  //
+    int frame;
+    SDL_RendererFlip flip;
+    int alpha;
+    bool wave;              // ANIMATION_WAVE, the frame is the wave offset
+#ifdef DEBUG_MODE
+    SDL_Rect body;
+#endif
+} RenderSprite;
+
+// Everything a frame draws, captured by Render_SubmitFrame()
+typedef struct {
+    int cameraX;                                // Top left of the view in the level, may be
+    int cameraY;                                // negative if the level is smaller than the screen
+    uint32_t tilesRevision;                     // Level::tilesRevision, 0 - nothing captured yet
+    SDL_Rect cells;                             // Level cells in the view: first column, row, and the counts
+    uint8_t tiles[VIEW_ROW_COUNT][VIEW_COLUMN_COUNT]; // Of these cells, copied only when they or the revision change
+    SDL_Rect tileSprites[TYPE_COUNT];           //
+    RenderSprite* sprites;
+    int spriteCount;
+    int spriteReserved;
+    MessageId message;
+} RenderFrame;
+
+// The frames are passed from the logic to the render thread by a triple
+// buffer: the logic fills one frame, the render thread draws another, and the
+// third is the newest complete one. Submitting a frame swaps it with the
+// newest, and the render thread swaps the newest with the drawn one, so
+// neither side waits for the other.
+//
+// SDL updates the renderer on the window events (e.g. its viewport on a
+// resize) by an event watch, which runs on the thread that sends the event.
+// So the window events are taken from the polling thread by an event filter,
+// and sent again by the render thread, which then updates its renderer
+// itself. The game gets them after that.
+enum { RENDER_WINDOW_EVENTS_MAX = 16 };
+
+static struct {
+    RenderFrame frames[3];
+    int filled;             // Index of the frame the logic fills
+    int newest;             //
+    int drawn;              // Index of the frame the render thread draws
+    bool fresh;             // The newest frame was not drawn yet
+
+    SDL_Thread* thread;     // NULL - the frames are drawn by Render_SubmitFrame()
+    SDL_threadID threadId;  //
+    SDL_mutex* mutex;
+    SDL_cond* submitted;    // A fresh frame, resume, a window event, or quit
+    SDL_cond* idle;         // The thread has drawn the frame
+    SDL_sem* ready;         // The thread has created the renderer, or failed to
+    bool drawing;           // The thread draws a frame
+    bool paused;            // The thread must not start drawing, see Render_Pause()
+    bool quit;
+    SDL_Event windowEvents[RENDER_WINDOW_EVENTS_MAX]; // To send on the render thread
+    int windowEventCount;
+
+    RenderOptions options;
+    bool vsyncActive;       // Supported by the renderer
+    const char* error;      // Why the renderer could not be created
+    char sdlError[256];     // SDL_GetError() on the render thread at that moment
+} render;
+
+// The frame is composed at the screen size into the canvas, and then the canvas
+// is scaled to the window by a single copy, so the sprites are drawn unscaled.
+// Used only by the drawing thread.
+static struct {
+    SDL_Texture* texture;   // NULL - the renderer has no render targets, see Render_CreateCanvas()
+} canvas;
+
+// The frame drawn by the in-tree rasterizer instead of the renderer. The draws
+// are recorded, and then executed by bands of cell rows in parallel, first
+// into the tile cache if it is outdated, then into the frame. The canvas is
+// then a streaming texture, updated once per frame. Used only by the drawing
+// thread.
+enum { RASTER_BAND_ROWS = 2 }; // Cell rows
+
+static struct {
+    bool enabled;
+    RasterCommandList commands;
+    RasterImage frame;
+    RasterImage tiles;      // Tile cache
+    RasterImage sprites;
+    RasterImage messages[MESSAGE_COUNT];
+} raster;
+
+// The level cells almost never change, and the view crosses a cell once in
+// many frames, so the cells in the view are drawn once into a texture, and
+// then the whole texture is drawn. Used only by the drawing thread.
+static struct {
+    SDL_Texture* texture;   // VIEW_COLUMN_COUNT x VIEW_ROW_COUNT cells
+    uint32_t revision;      // Of the cells in the texture, 0 - must be drawn
+    SDL_Rect cells;         // RenderFrame::cells in the texture
+    bool unsupported;       // The renderer has no render targets
+} tileCache;
 
 // The text must be one-line
-static void Render_InitMessage(MessageId id, const char* text, TTF_Font* font)
+static bool Render_InitMessage(MessageId id, const char* text, TTF_Font* font)
 {
     SDL_Surface* surface = TTF_RenderText_Solid(font, text, TEXT_COLOR);
-    messages[id] = SDL_CreateTextureFromSurface(renderer, surface);
+    if (surface == NULL)
+    {
+        return false;
+    }
+
+    bool created;
+    if (raster.enabled)
+    {
+        created = Raster_CreateImageFromSurface(&raster.messages[id], surface);
+    }
+    else
+    {
+        messages[id] = SDL_CreateTextureFromSurface(renderer, surface);
+        created = messages[id] != NULL;
+    }
+
     SDL_FreeSurface(surface);
+    return created;
 }
 
-static SDL_Texture* Render_LoadTexture(const char* filePath)
+static bool Render_LoadSprites(const char* filePath)
 {
     static const Uint8 transparent[3] = {90, 82, 104};
     Uint32 opaqueColor;
-    SDL_Texture* texture;
     SDL_Surface* surface;
 
     surface = SDL_LoadBMP(filePath);
-    Util_EnsureSDL(surface != NULL, "Can't load sprite sheet");
+    if (surface == NULL)
+    {
+        return false;
+    }
 
     opaqueColor = SDL_MapRGB(
         surface->format, transparent[0], transparent[1], transparent[2]
     );
     SDL_SetColorKey(surface, SDL_TRUE, opaqueColor);
 
-    texture = SDL_CreateTextureFromSurface(renderer, surface);
+    bool loaded;
+    if (raster.enabled)
+    {
+        loaded = Raster_CreateImageFromSurface(&raster.sprites, surface);
+    }
+    else
+    {
+        sprites = SDL_CreateTextureFromSurface(renderer, surface);
+        loaded = sprites != NULL;
+    }
+
     SDL_FreeSurface(surface);
 
-    return texture;
+    if (loaded && !raster.enabled)
+    {
+        int textureWidth, textureHeight;
+        SDL_QueryTexture(sprites, NULL, NULL, &textureWidth, &textureHeight);
+        batch.textureWidth = textureWidth;
+        batch.textureHeight = textureHeight;
+    }
+
+    return loaded;
 }
 
-void Render_Init(const char* spritesPath, const char* fontPath)
+static bool Render_CreateCanvas()
 {
-    // Create a window
-    window = SDL_CreateWindow(
-        "platformer",
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        LEVEL_WIDTH * SIZE_FACTOR, LEVEL_HEIGHT * SIZE_FACTOR,
-        SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
+    if (raster.enabled)
+    {
+        canvas.texture = SDL_CreateTexture(
+            renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+            SCREEN_WIDTH, SCREEN_HEIGHT
+        );
+
+        if (canvas.texture == NULL
+            || !Raster_CreateImage(&raster.frame, SCREEN_WIDTH, SCREEN_HEIGHT)
+            || !Raster_CreateImage(&raster.tiles, VIEW_COLUMN_COUNT * CELL_SIZE, VIEW_ROW_COUNT * CELL_SIZE))
+        {
+            return false;
+        }
+
+        SDL_SetTextureBlendMode(canvas.texture, SDL_BLENDMODE_NONE);
+        SDL_SetTextureScaleMode(canvas.texture, SDL_ScaleModeNearest);
+        Raster_InitCommands(&raster.commands);
+        return true;
+    }
+
+    canvas.texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+        SCREEN_WIDTH, SCREEN_HEIGHT
     );
-    Util_EnsureSDL(window != NULL, "Window could not be created!");
 
-    // Create a renderer
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    Util_EnsureSDL(renderer != NULL, "Renderer could not be created!");
+    if (canvas.texture != NULL)
+    {
+        SDL_SetTextureBlendMode(canvas.texture, SDL_BLENDMODE_NONE);
+        SDL_SetTextureScaleMode(canvas.texture, SDL_ScaleModeNearest);
+        return true;
+    }
+
+    // Without render targets the renderer scales each sprite itself
+    SDL_RenderSetLogicalSize(renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
+    SDL_RenderSetIntegerScale(renderer, SDL_TRUE);
+    tileCache.unsupported = true;
+    return true;
+}
+
+// Creates the renderer and the textures on the thread that draws, because the
+// renderer can be used only on the thread where it was created. Returns why it
+// failed, or NULL.
+static const char* Render_CreateRenderer()
+{
+    // SDL takes the first driver having all the requested flags, and tries the
+    // accelerated ones first, so no flags let it fall back to the software one
+    renderer = SDL_CreateRenderer(window, -1, render.options.vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+    if (renderer == NULL && render.options.vsync)
+    {
+        renderer = SDL_CreateRenderer(window, -1, 0);
+    }
+    if (renderer == NULL)
+    {
+        return "Renderer could not be created!";
+    }
+
+    // The driver may not support vsync even if it was requested
+    SDL_RendererInfo info;
+    const bool hasInfo = SDL_GetRendererInfo(renderer, &info) == 0;
+    render.vsyncActive = hasInfo && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+
+    // SDL draws each sprite of its software renderer by generic code, so the
+    // in-tree rasterizer is faster there
+    raster.enabled = render.options.backend == RENDER_BACKEND_RASTER
+        || (render.options.backend == RENDER_BACKEND_AUTO && hasInfo && (info.flags & SDL_RENDERER_SOFTWARE));
+
+    if (!Render_CreateCanvas())
+    {
+        return "Can't create the canvas";
+    }
 
     // Sprites
-    sprites = Render_LoadTexture(spritesPath);
+    if (!Render_LoadSprites(render.options.spritesPath))
+    {
+        return "Can't load sprite sheet";
+    }
+
+    batch.count = 0;
+
+    // Two triangles per quad, the vertices are: 0 - top left, 1 - top right,
+    // 2 - bottom right, 3 - bottom left
+    for (int i = 0; i < SPRITE_BATCH_SIZE; i++)
+    {
+        int* indices = &batch.indices[i * 6];
+        indices[0] = i * 4;
+        indices[1] = i * 4 + 1;
+        indices[2] = i * 4 + 2;
+        indices[3] = i * 4;
+        indices[4] = i * 4 + 2;
+        indices[5] = i * 4 + 3;
+    }
 
     // Open font
-    TTF_Font* font = TTF_OpenFont(fontPath, TEXT_FONT_SIZE);
-    Util_EnsureSDL(font != NULL, "Can't open font");
+    TTF_Font* font = TTF_OpenFont(render.options.fontPath, TEXT_FONT_SIZE);
+    if (font == NULL)
+    {
+        return "Can't open font";
+    }
 
     // Init messages
-    Render_InitMessage(MESSAGE_PLAYER_KILLED,  "You lost a life", font);
-    Render_InitMessage(MESSAGE_GAME_OVER,      "Game over",       font);
-    Render_InitMessage(MESSAGE_LEVEL_COMPLETE, "Level complete!", font);
+    const bool created =
+        Render_InitMessage(MESSAGE_PLAYER_KILLED,  "You lost a life", font) &&
+        Render_InitMessage(MESSAGE_GAME_OVER,      "Game over",       font) &&
+        Render_InitMessage(MESSAGE_LEVEL_COMPLETE, "Level complete!", font);
 
     // Close font
     TTF_CloseFont(font);
+
+    return created ? NULL : "Can't create the message textures";
 }
 
-void Render_Deinit()
+static void Render_DestroyRenderer()
 {
-    SDL_DestroyWindow(window);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyTexture(sprites);
-
     for (int i = 0; i < MESSAGE_COUNT; i++)
     {
         SDL_DestroyTexture(messages[i]);
+        Raster_FreeImage(&raster.messages[i]);
+        messages[i] = NULL;
+    }
+
+    Raster_FreeImage(&raster.frame);
+    Raster_FreeImage(&raster.tiles);
+    Raster_FreeImage(&raster.sprites);
+    Raster_FreeCommands(&raster.commands);
+    raster.enabled = false;
+
+    SDL_DestroyTexture(tileCache.texture);
+    SDL_DestroyTexture(canvas.texture);
+    SDL_DestroyTexture(sprites);
+    SDL_DestroyRenderer(renderer);
+    tileCache.texture = NULL;
+    tileCache.revision = 0;
+    tileCache.unsupported = false;
+    canvas.texture = NULL;
+    sprites = NULL;
+    renderer = NULL;
+}
+
+// Draws all the sprites collected in the batch
+static void Render_FlushSprites()
+{
+    if (batch.count > 0)
+    {
+        SDL_RenderGeometry(
+            renderer, sprites, batch.vertices, batch.count * 4, batch.indices, batch.count * 6
+        );
+        batch.count = 0;
     }
 }
 
-void Render_DrawSprite(SDL_Rect spriteRect, int x, int y, int frame, SDL_RendererFlip flip)
+// The sprite is drawn at the next Render_FlushSprites()
+static void Render_DrawSprite(SDL_Rect spriteRect, int x, int y, int frame, SDL_RendererFlip flip, int alpha)
 {
+    if (spriteRect.w <= 0 || spriteRect.h <= 0)
+    {
+        return;
+    }
+
     spriteRect.x += spriteRect.w * frame;
-    const SDL_Rect dstRect = (SDL_Rect) {
-        .x = x * SIZE_FACTOR,
-        .y = y * SIZE_FACTOR,
-        .w = spriteRect.w * SIZE_FACTOR,
-        .h = spriteRect.h * SIZE_FACTOR
-    };
-    SDL_RenderCopyEx(renderer, sprites, &spriteRect, &dstRect, 0, NULL, flip);
+
+    if (raster.enabled)
+    {
+        Raster_AddBlit(&raster.commands, &raster.sprites, spriteRect, x, y, flip, alpha);
+        return;
+    }
+
+    if (batch.count == SPRITE_BATCH_SIZE)
+    {
+        Render_FlushSprites();
+    }
+
+    const float left = x;
+    const float top = y;
+    const float right = left + spriteRect.w;
+    const float bottom = top + spriteRect.h;
+
+    float u0 = spriteRect.x / batch.textureWidth;
+    float v0 = spriteRect.y / batch.textureHeight;
+    float u1 = (spriteRect.x + spriteRect.w) / batch.textureWidth;
+    float v1 = (spriteRect.y + spriteRect.h) / batch.textureHeight;
+
+    if (flip & SDL_FLIP_HORIZONTAL)
+    {
+        const float u = u0; u0 = u1; u1 = u;
+    }
+
+    if (flip & SDL_FLIP_VERTICAL)
+    {
+        const float v = v0; v0 = v1; v1 = v;
+    }
+
+    const SDL_Color color = {255, 255, 255, alpha};
+    SDL_Vertex* vertices = &batch.vertices[batch.count * 4];
+    vertices[0] = (SDL_Vertex) {{left, top}, color, {u0, v0}};
+    vertices[1] = (SDL_Vertex) {{right, top}, color, {u1, v0}};
+    vertices[2] = (SDL_Vertex) {{right, bottom}, color, {u1, v1}};
+    vertices[3] = (SDL_Vertex) {{left, bottom}, color, {u0, v1}};
+    batch.count += 1;
 }
 
-static void Render_DrawObjectBody(Object* object)
+#ifdef DEBUG_MODE
+static void Render_DrawBody(SDL_Rect body)
 {
-    const SDL_Rect body = (SDL_Rect) {
-        .x = (object->x + object->type->body.x) * SIZE_FACTOR,
-        .y = (object->y + object->type->body.y) * SIZE_FACTOR,
-        .w = object->type->body.w * SIZE_FACTOR,
-        .h = object->type->body.h * SIZE_FACTOR
-    };
+    if (raster.enabled)
+    {
+        const SDL_Color color = {0, 255, 0, 255};
+        Raster_AddFill(&raster.commands, (SDL_Rect) {body.x, body.y, body.w, 1}, color);
+        Raster_AddFill(&raster.commands, (SDL_Rect) {body.x, body.y + body.h - 1, body.w, 1}, color);
+        Raster_AddFill(&raster.commands, (SDL_Rect) {body.x, body.y, 1, body.h}, color);
+        Raster_AddFill(&raster.commands, (SDL_Rect) {body.x + body.w - 1, body.y, 1, body.h}, color);
+        return;
+    }
 
     SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
     SDL_RenderDrawRect(renderer, &body);
 }
+#endif
 
-void Render_DrawObject(const Object* object)
+static void Render_DrawObject(const RenderSprite* object)
 {
-    const int frame = object->anim.frame;
-    const int flip = object->anim.flip;
-    const int x = object->x;
-    const int y = object->y;
-
-    SDL_SetTextureAlphaMod(sprites, object->anim.alpha);
+    const int frame = object->frame;
 
-    if (object->anim.type == ANIMATION_WAVE)
+    if (object->wave)
     {
-        SDL_Rect spriteRect = object->type->sprite;
+        SDL_Rect spriteRect = object->sprite;
         spriteRect.w -= frame;
-        Render_DrawSprite(spriteRect, x + frame, y, 0, flip);
+        Render_DrawSprite(spriteRect, object->x + frame, object->y, 0, object->flip, object->alpha);
 
         spriteRect.x += spriteRect.w;
         spriteRect.w = frame;
-        Render_DrawSprite(spriteRect, x, y, 0, flip);
+        Render_DrawSprite(spriteRect, object->x, object->y, 0, object->flip, object->alpha);
     }
     else
     {
-        Render_DrawSprite(object->type->sprite, x, y, frame, flip);
+        Render_DrawSprite(object->sprite, object->x, object->y, frame, object->flip, object->alpha);
     }
 
 #ifdef DEBUG_MODE
-    drawObjectBody(object);
+    Render_FlushSprites();
+    Render_DrawBody(object->body);
 #endif
-
-    SDL_SetTextureAlphaMod(sprites, 255);
 }
 
 static void Render_DrawBox(SDL_Rect box, int border, SDL_Color borderColor, SDL_Color contentColor)
@@ -163,6 +474,14 @@ static void Render_DrawBox(SDL_Rect box, int border, SDL_Color borderColor, SDL_
         .w = box.w + border * 2,
         .h = box.h + border * 2
     };
+
+    if (raster.enabled)
+    {
+        Raster_AddFill(&raster.commands, borderRect, borderColor);
+        Raster_AddFill(&raster.commands, box, contentColor);
+        return;
+    }
+
     SDL_SetRenderDrawColor(renderer, borderColor.r, borderColor.g, borderColor.b, borderColor.a);
     SDL_RenderFillRect(renderer, &borderRect);
 
@@ -170,14 +489,19 @@ static void Render_DrawBox(SDL_Rect box, int border, SDL_Color borderColor, SDL_
     SDL_RenderFillRect(renderer, &box);
 }
 
-void Render_DrawMessage(MessageId id)
+static void Render_DrawMessage(MessageId id)
 {
+    Render_FlushSprites();
+
     SDL_Texture* texture = messages[id];
 
-    SDL_Rect textRect = {.w = 0, .h = 0};
-    SDL_QueryTexture(texture, NULL, NULL, &textRect.w, &textRect.h);
-    textRect.x = (SIZE_FACTOR * LEVEL_WIDTH - textRect.w) / 2;
-    textRect.y = (SIZE_FACTOR * LEVEL_HEIGHT - textRect.h) / 2;
+    SDL_Rect textRect = {.w = raster.messages[id].width, .h = raster.messages[id].height};
+    if (!raster.enabled)
+    {
+        SDL_QueryTexture(texture, NULL, NULL, &textRect.w, &textRect.h);
+    }
+    textRect.x = (SCREEN_WIDTH - textRect.w) / 2;
+    textRect.y = (SCREEN_HEIGHT - textRect.h) / 2;
 
     const int padding = TEXT_BOX_PADDING;
     const SDL_Rect boxRect = {
@@ -188,28 +512,580 @@ void Render_DrawMessage(MessageId id)
     };
     Render_DrawBox(boxRect, TEXT_BOX_BORDER, TEXT_BOX_BORDER_COLOR, TEXT_BOX_CONTENT_COLOR);
 
-    SDL_RenderCopy(renderer, texture, NULL, &textRect);
+    if (raster.enabled)
+    {
+        const SDL_Rect imageRect = {0, 0, textRect.w, textRect.h};
+        Raster_AddBlit(&raster.commands, &raster.messages[id], imageRect, textRect.x, textRect.y, SDL_FLIP_NONE, 255);
+    }
+    else
+    {
+        SDL_RenderCopy(renderer, texture, NULL, &textRect);
+    }
+}
+
+// Draws the captured cells, the first one at x, y
+static void Render_DrawCells(const RenderFrame* frame, int x, int y)
+{
+    for (int r = 0; r < frame->cells.h; r++)
+    {
+        for (int c = 0; c < frame->cells.w; c++)
+        {
+            const SDL_Rect sprite = frame->tileSprites[frame->tiles[r][c]];
+            Render_DrawSprite(sprite, x + CELL_SIZE * c, y + CELL_SIZE * r, 0, SDL_FLIP_NONE, 255);
+        }
+    }
+}
+
+static bool Render_IsTileCacheValid(const RenderFrame* frame)
+{
+    return tileCache.revision == frame->tilesRevision && SDL_RectEquals(&tileCache.cells, &frame->cells);
+}
+
+// Draws the frame cells into the tile cache. Returns false if the renderer
+// does not support render targets.
+static bool Render_UpdateTileCache(const RenderFrame* frame)
+{
+    if (raster.enabled)
+    {
+        const SDL_Color black = {0, 0, 0, 255};
+        Raster_AddFill(&raster.commands, (SDL_Rect) {0, 0, raster.tiles.width, raster.tiles.height}, black);
+        Render_DrawCells(frame, 0, 0);
+        Raster_ExecuteCommands(&raster.commands, &raster.tiles, CELL_SIZE * RASTER_BAND_ROWS);
+
+        tileCache.revision = frame->tilesRevision;
+        tileCache.cells = frame->cells;
+        return true;
+    }
+
+    if (tileCache.unsupported)
+    {
+        return false;
+    }
+
+    if (tileCache.texture == NULL)
+    {
+        tileCache.texture = SDL_CreateTexture(
+            renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+            VIEW_COLUMN_COUNT * CELL_SIZE, VIEW_ROW_COUNT * CELL_SIZE
+        );
+
+        if (tileCache.texture == NULL)
+        {
+            tileCache.unsupported = true;
+            return false;
+        }
+
+        SDL_SetTextureBlendMode(tileCache.texture, SDL_BLENDMODE_NONE);
+    }
+
+    if (SDL_SetRenderTarget(renderer, tileCache.texture) != 0)
+    {
+        return false;
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    Render_DrawCells(frame, 0, 0);
+    Render_FlushSprites();
+
+    tileCache.revision = frame->tilesRevision;
+    tileCache.cells = frame->cells;
+    return true;
 }
 
-void Render_DrawScreen()
+// Copies the canvas to the window, scaled by the largest integer factor that
+// fits, centered between black bars. A window smaller than the screen gets
+// the canvas shrunk to fit.
+static void Render_DrawCanvas()
 {
-    // Level
-    for (int r = 0; r < ROW_COUNT; r++)
+    int width = SCREEN_WIDTH, height = SCREEN_HEIGHT;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+
+    const int scaleX = width / SCREEN_WIDTH;
+    const int scaleY = height / SCREEN_HEIGHT;
+    const int scale = scaleX < scaleY ? scaleX : scaleY;
+
+    SDL_Rect rect = {0, 0, SCREEN_WIDTH * scale, SCREEN_HEIGHT * scale};
+    if (scale == 0)
     {
-        for (int c = 0; c < COLUMN_COUNT; c++)
+        rect.w = width * SCREEN_HEIGHT < height * SCREEN_WIDTH ? width : height * SCREEN_WIDTH / SCREEN_HEIGHT;
+        rect.h = rect.w * SCREEN_HEIGHT / SCREEN_WIDTH;
+    }
+    rect.x = (width - rect.w) / 2;
+    rect.y = (height - rect.h) / 2;
+
+    SDL_SetRenderTarget(renderer, NULL);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, canvas.texture, NULL, &rect);
+}
+
+static void Render_DrawFrame(const RenderFrame* frame)
+{
+    TRACE_BEGIN("Render_DrawFrame");
+
+    // Level, into the tile cache if it is outdated
+    const bool cached = Render_IsTileCacheValid(frame) || Render_UpdateTileCache(frame);
+
+    // Where the first captured cell is in the view
+    const int cellsX = frame->cells.x * CELL_SIZE - frame->cameraX;
+    const int cellsY = frame->cells.y * CELL_SIZE - frame->cameraY;
+
+    if (raster.enabled)
+    {
+        // The tile cache covers the view, unless the level is smaller
+        if (cellsX > 0 || cellsY > 0)
         {
-            ObjectType* type = level->cells[r][c];
-            Render_DrawSprite(type->sprite, CELL_SIZE * c, CELL_SIZE * r, 0, SDL_FLIP_NONE);
+            const SDL_Color black = {0, 0, 0, 255};
+            Raster_AddFill(&raster.commands, (SDL_Rect) {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT}, black);
         }
+        Raster_AddCopy(&raster.commands, &raster.tiles, cellsX, cellsY);
+    }
+    else
+    {
+        SDL_SetRenderTarget(renderer, canvas.texture);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+    }
+
+    if (cached && !raster.enabled)
+    {
+        const SDL_Rect cacheRect = {cellsX, cellsY, VIEW_COLUMN_COUNT * CELL_SIZE, VIEW_ROW_COUNT * CELL_SIZE};
+        SDL_RenderCopy(renderer, tileCache.texture, NULL, &cacheRect);
+    }
+    else if (!cached)
+    {
+        Render_DrawCells(frame, cellsX, cellsY);
     }
 
     // Objects
-    const double dt = FrameControl_GetElapsedFrameTime() / 1000.0;
+    for (int i = 0; i < frame->spriteCount; i++)
+    {
+        Render_DrawObject(&frame->sprites[i]);
+    }
+
+    Render_FlushSprites();
+
+    if (frame->message != MESSAGE_NONE)
+    {
+        Render_DrawMessage(frame->message);
+    }
 
-    // for (ObjectListNode* iter = level->objects.first; iter != NULL; iter = iter->next)
-    for (ListNode* iter = level->objects.first; iter != NULL; iter = iter->next)
+    // The rasterized frame goes to SDL at once
+    if (raster.enabled)
     {
-        Object* object = iter->data;
+        Raster_ExecuteCommands(&raster.commands, &raster.frame, CELL_SIZE * RASTER_BAND_ROWS);
+        SDL_UpdateTexture(canvas.texture, NULL, raster.frame.pixels, raster.frame.width * sizeof(uint32_t));
+    }
+
+    if (canvas.texture)
+    {
+        Render_DrawCanvas();
+    }
+
+    TRACE_END();
+
+    TRACE_BEGIN("SDL_RenderPresent");
+    SDL_RenderPresent(renderer);
+    TRACE_END();
+}
+
+// Takes the window events sent by the other threads, see the render struct
+static int SDLCALL Render_FilterEvent(void* data, SDL_Event* event)
+{
+    (void)data;
+
+    if (event->type != SDL_WINDOWEVENT || SDL_ThreadID() == render.threadId)
+    {
+        return 1;
+    }
+
+    SDL_LockMutex(render.mutex);
+    if (render.windowEventCount < RENDER_WINDOW_EVENTS_MAX)
+    {
+        render.windowEventCount += 1;
+    }
+    render.windowEvents[render.windowEventCount - 1] = *event; // If full, the newest replaces the last one
+    SDL_CondSignal(render.submitted);
+    SDL_UnlockMutex(render.mutex);
+    return 0;
+}
+
+// Sends the window events again, on the render thread. Called with the mutex locked.
+static void Render_SendWindowEvents()
+{
+    SDL_Event events[RENDER_WINDOW_EVENTS_MAX];
+    const int count = render.windowEventCount;
+    memcpy(events, render.windowEvents, count * sizeof(SDL_Event));
+    render.windowEventCount = 0;
+    SDL_UnlockMutex(render.mutex);
+
+    for (int i = 0; i < count; i++)
+    {
+        SDL_PushEvent(&events[i]);
+    }
+
+    SDL_LockMutex(render.mutex);
+}
+
+static int Render_Thread(void* data)
+{
+    (void)data;
+    Trace_SetThreadName("render");
+    render.threadId = SDL_ThreadID();
+
+    render.error = Render_CreateRenderer();
+    if (render.error)
+    {
+        SDL_strlcpy(render.sdlError, SDL_GetError(), sizeof(render.sdlError));
+    }
+    SDL_SemPost(render.ready);
+
+    SDL_LockMutex(render.mutex);
+
+    while (!render.error)
+    {
+        while ((!render.fresh || render.paused) && render.windowEventCount == 0 && !render.quit)
+        {
+            SDL_CondWait(render.submitted, render.mutex);
+        }
+        if (render.quit)
+        {
+            break;
+        }
+        if (render.windowEventCount > 0)
+        {
+            Render_SendWindowEvents();
+            continue;
+        }
+
+        const int newest = render.newest;
+        render.newest = render.drawn;
+        render.drawn = newest;
+        render.fresh = false;
+        render.drawing = true;
+        SDL_UnlockMutex(render.mutex);
+
+        Render_DrawFrame(&render.frames[render.drawn]);
+
+        SDL_LockMutex(render.mutex);
+        render.drawing = false;
+        SDL_CondSignal(render.idle);
+    }
+
+    SDL_UnlockMutex(render.mutex);
+
+    Render_DestroyRenderer();
+    return 0;
+}
+
+void Render_Init(const RenderOptions* options)
+{
+    const int scale = options->scale > 0 ? options->scale : 1;
+
+    // Create a window. It stays on this thread, which polls its events.
+    window = SDL_CreateWindow(
+        "platformer",
+        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+        SCREEN_WIDTH * scale, SCREEN_HEIGHT * scale,
+        SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
+    );
+    Util_EnsureSDL(window != NULL, "Window could not be created!");
+
+    render.options = *options;
+    render.filled = 0;
+    render.newest = 1;
+    render.drawn = 2;
+    render.fresh = false;
+    render.drawing = false;
+    render.paused = false;
+    render.quit = false;
+    render.windowEventCount = 0;
+    render.thread = NULL;
+
+    if (!options->thread)
+    {
+        const char* error = Render_CreateRenderer();
+        Util_EnsureSDL(error == NULL, error);
+        return;
+    }
+
+    render.mutex = SDL_CreateMutex();
+    render.submitted = SDL_CreateCond();
+    render.idle = SDL_CreateCond();
+    render.ready = SDL_CreateSemaphore(0);
+    Util_EnsureSDL(render.mutex && render.submitted && render.idle && render.ready, "Could not create the render thread");
+
+    render.thread = SDL_CreateThread(Render_Thread, "render", NULL);
+    Util_EnsureSDL(render.thread != NULL, "Could not create the render thread");
+
+    SDL_SemWait(render.ready);
+    if (render.error)
+    {
+        SDL_SetError("%s", render.sdlError);
+        Util_EnsureSDL(false, render.error);
+    }
+
+    SDL_SetEventFilter(Render_FilterEvent, NULL);
+}
+
+void Render_Pause()
+{
+    if (!render.thread)
+    {
+        return;
+    }
+
+    SDL_LockMutex(render.mutex);
+    render.paused = true;
+    while (render.drawing)
+    {
+        SDL_CondWait(render.idle, render.mutex);
+    }
+    SDL_UnlockMutex(render.mutex);
+}
+
+void Render_Resume()
+{
+    if (!render.thread)
+    {
+        return;
+    }
+
+    SDL_LockMutex(render.mutex);
+    render.paused = false;
+    SDL_CondSignal(render.submitted);
+    SDL_UnlockMutex(render.mutex);
+}
+
+bool Render_IsVsync()
+{
+    return render.vsyncActive;
+}
+
+bool Render_IsThreaded()
+{
+    return render.thread != NULL;
+}
+
+bool Render_ParseBackend(const char* name, RenderBackend* backend)
+{
+    static const char* const NAMES[] = {"auto", "sdl", "raster"};
+
+    for (int i = 0; i < (int)(sizeof(NAMES) / sizeof(NAMES[0])); i++)
+    {
+        if (strcmp(name, NAMES[i]) == 0)
+        {
+            *backend = (RenderBackend)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Valid after Render_Init()
+const char* Render_GetBackendName()
+{
+    return raster.enabled ? Raster_GetKernelName() : "sdl";
+}
+
+void Render_Deinit()
+{
+    if (render.thread)
+    {
+        SDL_SetEventFilter(NULL, NULL);
+
+        SDL_LockMutex(render.mutex);
+        render.quit = true;
+        SDL_CondSignal(render.submitted);
+        SDL_UnlockMutex(render.mutex);
+
+        SDL_WaitThread(render.thread, NULL);
+        render.thread = NULL;
+    }
+    else
+    {
+        Render_DestroyRenderer();
+    }
+
+    SDL_DestroySemaphore(render.ready);
+    SDL_DestroyCond(render.idle);
+    SDL_DestroyCond(render.submitted);
+    SDL_DestroyMutex(render.mutex);
+    render.ready = NULL;
+    render.idle = NULL;
+    render.submitted = NULL;
+    render.mutex = NULL;
+
+    for (int i = 0; i < 3; i++)
+    {
+        free(render.frames[i].sprites);
+        render.frames[i] = (RenderFrame) {0};
+    }
+
+    SDL_DestroyWindow(window);
+    window = NULL;
+}
+
+// Returns the object position between the previous and the current logic steps
+static void Render_GetObjectPos(const Object* object, double alpha, int* x, int* y)
+{
+    const double objectX = Scalar_ToDouble(object->x);
+    const double objectY = Scalar_ToDouble(object->y);
+    const double prevX = Scalar_ToDouble(object->prevX);
+    const double prevY = Scalar_ToDouble(object->prevY);
+    const double dx = objectX - prevX;
+    const double dy = objectY - prevY;
+
+    // Long jumps are teleports or level changes, they are not smoothed
+    if (fabs(dx) > INTERPOLATION_MAX_DISTANCE || fabs(dy) > INTERPOLATION_MAX_DISTANCE)
+    {
+        *x = objectX;
+        *y = objectY;
+    }
+    else
+    {
+        *x = prevX + dx * alpha;
+        *y = prevY + dy * alpha;
+    }
+}
+
+// Returns the view position along an axis: the target in the middle, but the
+// view not beyond the level. A level smaller than the screen is centered.
+static int Render_GetCamera(int target, int levelSize, int screenSize)
+{
+    if (levelSize <= screenSize)
+    {
+        return (levelSize - screenSize) / 2;
+    }
+
+    const int camera = target - screenSize / 2;
+    return camera < 0 ? 0 : camera > levelSize - screenSize ? levelSize - screenSize : camera;
+}
+
+// Copies from the game state all that the frame draws. The object types are
+// copied by value, because the level init may change their sprites.
+static void Render_CaptureFrame(RenderFrame* frame, MessageId message)
+{
+    const double alpha = FrameControl_GetAlpha();
+
+    // The view follows the player as it is drawn
+    int playerX, playerY;
+    Render_GetObjectPos((const Object*)&player, alpha, &playerX, &playerY);
+    frame->cameraX = Render_GetCamera(playerX + CELL_HALF, Level_GetWidth(level), SCREEN_WIDTH);
+    frame->cameraY = Render_GetCamera(playerY + CELL_HALF, Level_GetHeight(level), SCREEN_HEIGHT);
+
+    // The cells in the view, the camera is negative only in a level smaller than the screen
+    const int c0 = frame->cameraX > 0 ? frame->cameraX / CELL_SIZE : 0;
+    const int r0 = frame->cameraY > 0 ? frame->cameraY / CELL_SIZE : 0;
+    const int c1 = (frame->cameraX + SCREEN_WIDTH + CELL_SIZE - 1) / CELL_SIZE;
+    const int r1 = (frame->cameraY + SCREEN_HEIGHT + CELL_SIZE - 1) / CELL_SIZE;
+    const SDL_Rect cells = {
+        c0, r0,
+        (c1 < level->columnCount ? c1 : level->columnCount) - c0,
+        (r1 < level->rowCount ? r1 : level->rowCount) - r0
+    };
+
+    if (frame->tilesRevision != level->tilesRevision || !SDL_RectEquals(&frame->cells, &cells))
+    {
+        frame->tilesRevision = level->tilesRevision;
+        frame->cells = cells;
+
+        for (int r = 0; r < cells.h; r++)
+        {
+            memcpy(frame->tiles[r], &level->tiles[Level_GetCell(level, cells.y + r, cells.x)], cells.w);
+        }
+
+        for (int i = 0; i < TYPE_COUNT; i++)
+        {
+            frame->tileSprites[i] = objectTypes[i].sprite;
+        }
+    }
+
+    if (frame->spriteReserved < level->objects.count)
+    {
+        frame->spriteReserved = level->objects.count * 2;
+        frame->sprites = (RenderSprite*)realloc(frame->sprites, frame->spriteReserved * sizeof(RenderSprite));
+        Util_EnsureSDL(frame->sprites != NULL, "Could not capture the frame.");
+    }
+
+    frame->spriteCount = 0;
+
+    for (int i = 0; i < level->objects.count; i++)
+    {
+        const Object* object = level->objects.array[i];
+
+        if (object->removed)
+        {
+            continue;
+        }
+
+        int x, y;
+        Render_GetObjectPos(object, alpha, &x, &y);
+        x -= frame->cameraX;
+        y -= frame->cameraY;
+
+        if (x <= -VIEW_MARGIN || x >= SCREEN_WIDTH + VIEW_MARGIN
+            || y <= -VIEW_MARGIN || y >= SCREEN_HEIGHT + VIEW_MARGIN)
+        {
+            continue;
+        }
+
+        RenderSprite* sprite = &frame->sprites[frame->spriteCount];
+        frame->spriteCount += 1;
+
+        sprite->sprite = object->type->sprite;
+        sprite->x = x;
+        sprite->y = y;
+        sprite->frame = object->anim.frame;
+        sprite->flip = object->anim.flip;
+        sprite->alpha = object->anim.alpha;
+        sprite->wave = object->anim.type == ANIMATION_WAVE;
+
+#ifdef DEBUG_MODE
+        sprite->body = (SDL_Rect) {
+            .x = Scalar_ToDouble(object->x) + object->type->body.x - frame->cameraX,
+            .y = Scalar_ToDouble(object->y) + object->type->body.y - frame->cameraY,
+            .w = object->type->body.w,
+            .h = object->type->body.h
+        };
+#endif
+    }
+
+    frame->message = message;
+}
+
+void Render_SubmitFrame(MessageId message)
+{
+    RenderFrame* frame = &render.frames[render.filled];
+
+    TRACE_BEGIN("Render_CaptureFrame");
+    Render_CaptureFrame(frame, message);
+    TRACE_END();
+
+    if (!render.thread)
+    {
+        Render_DrawFrame(frame);
+        return;
+    }
+
+    SDL_LockMutex(render.mutex);
+    render.filled = render.newest;
+    render.newest = frame - render.frames;
+    render.fresh = true;
+    SDL_CondSignal(render.submitted);
+    SDL_UnlockMutex(render.mutex);
+}
+
+void Render_AnimateObjects()
+{
+    const Scalar dt = FrameControl_GetDeltaTime();
+
+    for (int i = 0; i < level->objects.count; i++)
+    {
+        Object* object = level->objects.array[i];
         Animation* anim = &object->anim;
 
         if (object->removed)
@@ -235,8 +1111,6 @@ void Render_DrawScreen()
                     ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
             }
         }
-
-        Render_DrawObject(object);
     }
 }
 
@@ -247,7 +1121,7 @@ static void Render_SetAnimationEx(Object* object, int start, int end, int fps, i
     anim->type = type;
     anim->frameStart = start;
     anim->frameEnd = end;
-    anim->frameDelay = 1.0 / fps;
+    anim->frameDelay = fps > 0 ? Scalar_Div(SCALAR(1), Scalar_FromInt(fps)) : SCALAR_MAX;
 
     if ((anim->frame < anim->frameStart) || (anim->frame > anim->frameEnd))
     {
@@ -0,0 +1,158 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#include "replay.h"
+#include <stdio.h>
+#include <string.h>
+
+enum { REPLAY_VERSION = 1 };
+enum { REPLAY_LONG_FRAME = 0x80 };
+
+static const char REPLAY_MAGIC[4] = {'P', 'L', 'R', 'P'};
+
+typedef enum {
+    REPLAY_NONE = 0,
+    REPLAY_RECORDING,
+    REPLAY_PLAYING
+} ReplayMode;
+
+static struct {
+    ReplayMode mode;
+    FILE* file;
+} replay = {REPLAY_NONE, NULL};
+
+// The values are written byte by byte, so the files do not depend on the
+// platform byte order
+static void Replay_WriteUint(uint64_t value, int size)
+{
+    uint8_t bytes[8];
+
+    for (int i = 0; i < size; i++)
+    {
+        bytes[i] = (uint8_t)(value >> (i * 8));
+    }
+
+    fwrite(bytes, 1, size, replay.file);
+}
+
+static bool Replay_ReadUint(uint64_t* value, int size)
+{
+    uint8_t bytes[8];
+
+    if (fread(bytes, 1, size, replay.file) != (size_t)size)
+    {
+        return false;
+    }
+
+    *value = 0;
+    for (int i = 0; i < size; i++)
+    {
+        *value |= (uint64_t)bytes[i] << (i * 8);
+    }
+    return true;
+}
+
+bool Replay_StartRecording(const char* path, const ReplayHeader* header)
+{
+    Replay_Stop();
+
+    replay.file = fopen(path, "wb");
+    if (!replay.file)
+    {
+        return false;
+    }
+
+    fwrite(REPLAY_MAGIC, 1, sizeof(REPLAY_MAGIC), replay.file);
+    Replay_WriteUint(REPLAY_VERSION, 4);
+    Replay_WriteUint(header->seed, 4);
+    Replay_WriteUint(header->tickRate, 4);
+
+    replay.mode = REPLAY_RECORDING;
+    return true;
+}
+
+bool Replay_StartPlayback(const char* path, ReplayHeader* header)
+{
+    Replay_Stop();
+
+    replay.file = fopen(path, "rb");
+    if (!replay.file)
+    {
+        return false;
+    }
+
+    char magic[sizeof(REPLAY_MAGIC)];
+    uint64_t version, seed, tickRate;
+
+    if (fread(magic, 1, sizeof(magic), replay.file) != sizeof(magic)
+        || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0
+        || !Replay_ReadUint(&version, 4) || version != REPLAY_VERSION
+        || !Replay_ReadUint(&seed, 4)
+        || !Replay_ReadUint(&tickRate, 4))
+    {
+        Replay_Stop();
+        return false;
+    }
+
+    header->seed = (uint32_t)seed;
+    header->tickRate = (uint32_t)tickRate;
+
+    replay.mode = REPLAY_PLAYING;
+    return true;
+}
+
+void Replay_Stop()
+{
+    if (replay.file)
+    {
+        fclose(replay.file);
+    }
+
+    replay.file = NULL;
+    replay.mode = REPLAY_NONE;
+}
+
+bool Replay_IsRecording()
+{
+    return replay.mode == REPLAY_RECORDING;
+}
+
+bool Replay_IsPlaying()
+{
+    return replay.mode == REPLAY_PLAYING;
+}
+
+void Replay_RecordFrame(uint8_t keys, uint64_t frameTime)
+{
+    if (replay.mode != REPLAY_RECORDING)
+    {
+        return;
+    }
+
+    if (frameTime > UINT32_MAX)
+    {
+        Replay_WriteUint(keys | REPLAY_LONG_FRAME, 1);
+        Replay_WriteUint(frameTime, 8);
+    }
+    else
+    {
+        Replay_WriteUint(keys, 1);
+        Replay_WriteUint(frameTime, 4);
+    }
+}
+
+bool Replay_PlayFrame(uint8_t* keys, uint64_t* frameTime)
+{
+    uint64_t value;
+
+    if (replay.mode != REPLAY_PLAYING || !Replay_ReadUint(&value, 1))
+    {
+        return false;
+    }
+
+    *keys = (uint8_t)(value & ~REPLAY_LONG_FRAME);
+    return Replay_ReadUint(frameTime, (value & REPLAY_LONG_FRAME) ? 8 : 4);
+}
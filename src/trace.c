@@ -0,0 +1,192 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#include "trace.h"
+
+#ifdef PLATFORMER_TRACE
+
+#include "helpers.h"
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum {
+    TRACE_RING_SIZE = 1 << 16,  // Zones kept per thread
+    TRACE_MAX_DEPTH = 32,       // Nesting of the open zones
+    TRACE_MAX_THREADS = 32
+};
+
+typedef struct {
+    const char* name;
+    int arg;
+    uint64_t start;             // Ticks
+    uint64_t end;               //
+} TraceZone;
+
+typedef struct {
+    TraceZone* zones;           // Ring of the finished zones
+    uint64_t zoneCount;         // All finished, the last ones are in the ring
+    TraceZone open[TRACE_MAX_DEPTH];
+    int depth;                  // May be > TRACE_MAX_DEPTH, then the deepest zones are not recorded
+    const char* threadName;
+} TraceBuffer;
+
+static struct {
+    TraceBuffer* buffers[TRACE_MAX_THREADS];
+    atomic_int bufferCount;
+
+    // The tick rate is measured against the SDL counter, between the first
+    // zone and the export
+    atomic_flag started;
+    uint64_t startTicks;
+    uint64_t startCounter;
+} trace = {.started = ATOMIC_FLAG_INIT};
+
+static _Thread_local TraceBuffer* threadBuffer = NULL;
+
+// The time stamp counter where available: it is read in a few cycles
+static inline uint64_t Trace_Now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return SDL_GetPerformanceCounter();
+#endif
+}
+
+static TraceBuffer* Trace_GetBuffer()
+{
+    if (threadBuffer)
+    {
+        return threadBuffer;
+    }
+
+    if (!atomic_flag_test_and_set(&trace.started))
+    {
+        trace.startCounter = SDL_GetPerformanceCounter();
+        trace.startTicks = Trace_Now();
+    }
+
+    const int index = atomic_fetch_add(&trace.bufferCount, 1);
+    if (index >= TRACE_MAX_THREADS)
+    {
+        return NULL;
+    }
+
+    TraceBuffer* buffer = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+    Util_EnsureSDL(buffer != NULL, "Could not allocate the trace.");
+    buffer->zones = (TraceZone*)malloc(TRACE_RING_SIZE * sizeof(TraceZone));
+    Util_EnsureSDL(buffer->zones != NULL, "Could not allocate the trace.");
+    trace.buffers[index] = buffer;
+    threadBuffer = buffer;
+    return buffer;
+}
+
+void Trace_Begin(const char* name, int arg)
+{
+    TraceBuffer* buffer = Trace_GetBuffer();
+    if (!buffer)
+    {
+        return;
+    }
+
+    if (buffer->depth < TRACE_MAX_DEPTH)
+    {
+        buffer->open[buffer->depth] = (TraceZone){name, arg, Trace_Now(), 0};
+    }
+    buffer->depth += 1;
+}
+
+void Trace_End()
+{
+    TraceBuffer* buffer = threadBuffer;
+    if (!buffer || buffer->depth == 0)
+    {
+        return;
+    }
+
+    buffer->depth -= 1;
+    if (buffer->depth < TRACE_MAX_DEPTH)
+    {
+        TraceZone* zone = &buffer->zones[buffer->zoneCount % TRACE_RING_SIZE];
+        *zone = buffer->open[buffer->depth];
+        zone->end = Trace_Now();
+        buffer->zoneCount += 1;
+    }
+}
+
+void Trace_SetThreadName(const char* name)
+{
+    TraceBuffer* buffer = Trace_GetBuffer();
+    if (buffer)
+    {
+        buffer->threadName = name;
+    }
+}
+
+bool Trace_Export(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    // Ticks per microsecond
+    const double counterTime = (double)(SDL_GetPerformanceCounter() - trace.startCounter)
+        / SDL_GetPerformanceFrequency();
+    const uint64_t ticks = Trace_Now() - trace.startTicks;
+    const double tickRate = counterTime > 0 ? ticks / counterTime / 1e6 : 1.0;
+
+    int bufferCount = atomic_load(&trace.bufferCount);
+    bufferCount = bufferCount < TRACE_MAX_THREADS ? bufferCount : TRACE_MAX_THREADS;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+
+    for (int t = 0; t < bufferCount; t++)
+    {
+        const TraceBuffer* buffer = trace.buffers[t];
+        if (!buffer)
+        {
+            continue;
+        }
+
+        if (buffer->threadName)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", t, buffer->threadName);
+            first = false;
+        }
+
+        const uint64_t count = buffer->zoneCount < TRACE_RING_SIZE ? buffer->zoneCount : TRACE_RING_SIZE;
+
+        for (uint64_t i = buffer->zoneCount - count; i < buffer->zoneCount; i++)
+        {
+            const TraceZone* zone = &buffer->zones[i % TRACE_RING_SIZE];
+
+            fprintf(file, "%s{\"name\":\"%s", first ? "" : ",\n", zone->name);
+            if (zone->arg >= 0)
+            {
+                fprintf(file, ":%d", zone->arg);
+            }
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                t, (int64_t)(zone->start - trace.startTicks) / tickRate, (zone->end - zone->start) / tickRate);
+            first = false;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+
+#endif // PLATFORMER_TRACE
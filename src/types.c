@@ -7,123 +7,203 @@
 #include "types.h"
 #include "render.h"
 #include "objects.h"
+#include "helpers.h"
+#include <string.h>
 
-enum { MIN_FRAME_RATE = 24 };
+enum { MIN_FRAME_RATE = 4 };
 const uint64_t MAX_DELTA_TIME = 1000 / MIN_FRAME_RATE;
-const uint64_t MAX_SPEED = MIN_FRAME_RATE * CELL_SIZE;
 
 ObjectType objectTypes[TYPE_COUNT];
 
-void Types_ClearList(List* list)
+enum { OBJECT_ARRAY_MIN_RESERVED = 16 };
+
+void ObjectArray_Init(ObjectArray* objects)
 {
-    ListNode* iter = list->first;
+    objects->array = NULL;
+    objects->reserved = 0;
+    objects->count = 0;
+}
 
-    while (iter != NULL)
+void ObjectArray_Append(ObjectArray* objects, Object* object)
+{
+    if (objects->count == objects->reserved)
     {
-        Object* obj = (Object*)iter->data;
+        const int reserved = objects->reserved > 0 ? objects->reserved * 2 : OBJECT_ARRAY_MIN_RESERVED;
+        Object** array = (Object**)realloc(objects->array, reserved * sizeof(Object*));
+        Util_EnsureSDL(array != NULL, "Could not add an object.");
+        objects->array = array;
+        objects->reserved = reserved;
+    }
+
+    objects->array[objects->count++] = object;
+}
+
+void ObjectArray_Free(ObjectArray* objects)
+{
+    free(objects->array);
+    ObjectArray_Init(objects);
+}
+
+void ObjectArray_Clean(ObjectArray* objects, ObjectPool* pool)
+{
+    int i = 0;
 
-        if (obj->removed) {
-            ListNode* rmNode = iter;
+    while (i < objects->count)
+    {
+        Object* object = objects->array[i];
 
-            iter = iter->next;
-            List_Remove(list, rmNode);
-        } else {
-            iter = iter->next;
+        if (object->removed)
+        {
+            // Move the last object to this place and check it on the next iteration
+            objects->array[i] = objects->array[--objects->count];
+            ObjectPool_Release(pool, object);
+        }
+        else
+        {
+            i++;
         }
     }
 }
 
-// static inline bool ObjectList_empty(ObjectList* objs)
-// {
-//     return objs->first == NULL;
-// }
-
-// void ObjectList_init(ObjectList* objs)
-// {
-//     objs->first = NULL;
-//     objs->last = NULL;
-// }
-
-// void ObjectList_append(ObjectList* objects, Object* object)
-// {
-//     ObjectListNode* new_node = (ObjectListNode*)malloc(sizeof(ObjectListNode));
-//     new_node->data = object;
-//     new_node->next = NULL;
-
-//     if (ObjectList_empty(objects))
-//     {
-//         objects->first = new_node;
-//         objects->last = new_node;
-//     }
-//     else
-//     {
-//         objects->last->next = new_node;
-//         objects->last = new_node;
-//     }
-// }
-
-// void ObjectList_free(ObjectList* objs)
-// {
-//     while (!ObjectList_empty(objs))
-//     {
-//         ObjectListNode* rm = objs->first;
-//         objs->first = objs->first->next;
-//         free(rm);
-//     }
-//     ObjectList_init(objs);
-// }
-
-// void ObjectList_clean(ObjectList* objs)
-// {
-//     ObjectListNode* iter = objs->first;
-//     ObjectListNode* rm_node;
-//     Object* rm_data;
-
-//     // Remove the firsts if needed
-//     while (iter != NULL && iter->data->removed)
-//     {
-//         rm_node = iter;
-//         rm_data = rm_node->data;
-//         objs->first = iter->next;
-
-//         iter = iter->next;
-
-//         free(rm_node);
-//         free(rm_data); // NOTE: a struct 'Player' é passada, mas eu não sei se é alocada dinamicamente
-//     }
-
-//     // Remove the rest if needed
-//     while (iter != NULL && iter->next != NULL)
-//     {
-//         if (iter->next->data->removed)
-//         {
-//             rm_node = iter->next;
-//             rm_data = rm_node->data;
-//             iter->next = rm_node->next;
-
-//             free(rm_node);
-//             free(rm_data);
-//         }
-
-//         iter = iter->next;
-//     }
-// }
+void ObjectPool_Init(ObjectPool* pool)
+{
+    pool->slabs = NULL;
+    pool->slab = NULL;
+    pool->slabUsed = 0;
+    pool->free = NULL;
+    pool->used = 0;
+    pool->slabCount = 0;
+}
+
+Object* ObjectPool_Alloc(ObjectPool* pool)
+{
+    ObjectSlot* slot = pool->free;
+
+    if (slot != NULL)
+    {
+        pool->free = slot->next;
+    }
+    else
+    {
+        if (pool->slab == NULL || pool->slabUsed == OBJECT_SLAB_SIZE)
+        {
+            // Take the next slab, allocate it if this is the last one
+            ObjectSlab* next = pool->slab != NULL ? pool->slab->next : pool->slabs;
+
+            if (next == NULL)
+            {
+                next = (ObjectSlab*)malloc(sizeof(ObjectSlab));
+                Util_EnsureSDL(next != NULL, "Could not allocate the objects.");
+                next->next = NULL;
+
+                if (pool->slab != NULL)
+                {
+                    pool->slab->next = next;
+                }
+                else
+                {
+                    pool->slabs = next;
+                }
+
+                pool->slabCount += 1;
+            }
+
+            pool->slab = next;
+            pool->slabUsed = 0;
+        }
+
+        slot = &pool->slab->slots[pool->slabUsed++];
+    }
+
+    pool->used += 1;
+    return &slot->object;
+}
+
+void ObjectPool_Release(ObjectPool* pool, Object* object)
+{
+    ObjectSlot* slot = (ObjectSlot*)object;
+    slot->next = pool->free;
+    pool->free = slot;
+    pool->used -= 1;
+}
+
+void ObjectPool_Reset(ObjectPool* pool)
+{
+    pool->slab = NULL;
+    pool->slabUsed = 0;
+    pool->free = NULL;
+    pool->used = 0;
+}
+
+void ObjectPool_Free(ObjectPool* pool)
+{
+    while (pool->slabs != NULL)
+    {
+        ObjectSlab* slab = pool->slabs;
+        pool->slabs = slab->next;
+        free(slab);
+    }
+
+    ObjectPool_Init(pool);
+}
 
 // Object constructors
 
+static uint8_t Types_GetCellFlags(const ObjectType* type)
+{
+    uint8_t flags = type->solid & SOLID_ALL;
+
+    switch (type->generalTypeId)
+    {
+        case TYPE_LADDER: flags |= CELL_LADDER; break;
+        case TYPE_WATER:  flags |= CELL_WATER;  break;
+        case TYPE_SPIKE:  flags |= CELL_SPIKE;  break;
+        case TYPE_DOOR:   flags |= CELL_DOOR;   break;
+        default: break;
+    }
+
+    return flags;
+}
+
 void Types_CreateStaticObject(Level* level, ObjectTypeId typeId, int r, int c)
 {
-    level->cells[r][c] = &objectTypes[typeId];
+    const int cell = Level_GetCell(level, r, c);
+    level->tiles[cell] = (uint8_t)typeId;
+    level->cellFlags[cell] = Types_GetCellFlags(&objectTypes[typeId]);
+    Types_InvalidateTiles(level);
+}
+
+// The revisions are unique among all levels, so the renderer knows that its
+// tile cache is outdated also when another level is shown
+void Types_InvalidateTiles(Level* level)
+{
+    static uint32_t revision = 0;
+    revision += 1;
+    level->tilesRevision = revision;
+}
+
+void Types_SetTiles(Level* level, const uint8_t* tiles)
+{
+    const int cellCount = level->rowCount * level->columnCount;
+    memcpy(level->tiles, tiles, cellCount);
+
+    for (int i = 0; i < cellCount; i++)
+    {
+        level->cellFlags[i] = Types_GetCellFlags(&objectTypes[level->tiles[i]]);
+    }
+
+    Types_InvalidateTiles(level);
 }
 
 Object* Types_CreateObject(Level* level, ObjectTypeId typeId, int r, int c)
 {
-    Object* object = (Object*)malloc(sizeof(Object));
+    Object* object = ObjectPool_Alloc(&level->pool);
     Types_InitObject(object, typeId);
-    object->x = CELL_SIZE * c;
-    object->y = CELL_SIZE * r;
-    // ObjectList_append(&level->objects, object);
-    List_Insert(&level->objects, object);
+    object->x = Scalar_FromInt(CELL_SIZE * c);
+    object->y = Scalar_FromInt(CELL_SIZE * r);
+    object->prevX = object->x;
+    object->prevY = object->y;
+    ObjectArray_Append(&level->objects, object);
     return object;
 }
 
@@ -134,6 +214,8 @@ void Types_InitObject(Object* object, ObjectTypeId typeId)
     object->y = 0;
     object->vx = 0;
     object->vy = 0;
+    object->prevX = 0;
+    object->prevY = 0;
     object->removed = false;
     object->state = 0;
     object->data = 0;
@@ -162,22 +244,60 @@ void Types_InitPlayer(Player* player)
     List_Init(&player->items);
 }
 
-void Types_InitLevel(Level* level)
+static void Types_ClearCells(Level* level)
 {
-    for (int r = 0; r < ROW_COUNT; r++)
-    {
-        for (int c = 0; c < COLUMN_COUNT; c++)
-        {
-            level->cells[r][c] = &objectTypes[TYPE_NONE];
-        }
-    }
+    const int cellCount = level->rowCount * level->columnCount;
+    memset(level->tiles, TYPE_NONE, cellCount);
+    memset(level->cellFlags, Types_GetCellFlags(&objectTypes[TYPE_NONE]), cellCount);
+}
+
+void Types_InitLevel(Level* level, int rowCount, int columnCount)
+{
+    level->rowCount = rowCount;
+    level->columnCount = columnCount;
+    level->tiles = (uint8_t*)malloc(rowCount * columnCount);
+    level->cellFlags = (uint8_t*)malloc(rowCount * columnCount);
+    Util_EnsureSDL(level->tiles && level->cellFlags, "Could not allocate the level.");
+
+    Types_ClearCells(level);
 
     level->init = 0;
     level->r = 0;
     level->c = 0;
+    level->played = false;
+    Types_InvalidateTiles(level);
+
+    ObjectArray_Init(&level->objects);
+    ObjectPool_Init(&level->pool);
+}
 
-    // ObjectList_init(&level->objects);
-    List_Init(&level->objects);
+// Empties the level to fill it again, e.g. with another part of the world. The objects
+// are released, but their memory is kept.
+void Types_ResetLevel(Level* level)
+{
+    Types_ClearCells(level);
+
+    level->init = 0;
+    level->r = 0;
+    level->c = 0;
+    level->played = false;
+    Types_InvalidateTiles(level);
+    level->objects.count = 0;
+
+    ObjectPool_Reset(&level->pool);
+}
+
+void Types_DeinitLevel(Level* level)
+{
+    ObjectArray_Free(&level->objects);
+    ObjectPool_Free(&level->pool);
+
+    free(level->tiles);
+    free(level->cellFlags);
+    level->tiles = NULL;
+    level->cellFlags = NULL;
+    level->rowCount = 0;
+    level->columnCount = 0;
 }
 
 
@@ -196,7 +316,7 @@ static void initTypeEx(ObjectTypeId typeId, ObjectTypeId generalTypeId, int soli
     type->sprite.h = spriteHeight;
     type->body = body;
     type->solid = solid;
-    type->speed = speed;
+    type->speed = Scalar_FromDouble(speed);
     type->onInit = onInit;
     type->onFrame = onFrame;
     type->onHit = onHit;
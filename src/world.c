@@ -0,0 +1,642 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+#include "world.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum {
+    WORLD_HEADER_SIZE = 9 * 4,
+    WORLD_INDEX_ENTRY_SIZE = 2 * 4,
+    WORLD_SPAWN_SIZE = 4
+};
+
+static const char WORLD_MAGIC[4] = {'P', 'L', 'W', 'D'};
+
+_Static_assert(sizeof(WorldSpawn) == WORLD_SPAWN_SIZE, "WorldSpawn is read from the file as is");
+
+static char worldError[256] = "";
+
+static void World_SetError(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(worldError, sizeof(worldError), format, args);
+    va_end(args);
+}
+
+const char* World_GetError()
+{
+    return worldError;
+}
+
+// The values are read and written byte by byte, so the files do not depend on
+// the platform byte order
+static inline uint32_t World_ReadUint32(const uint8_t* bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static inline void World_WriteUint32(uint8_t* bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        bytes[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+// Compilation
+
+typedef struct {
+    const char** lines;     // Rows of the cells, without the comments
+    int* lengths;           //
+    int rowCount;
+    int columnCount;
+    int levelRowCount;      // Size of a level
+    int levelColumnCount;   //
+} WorldText;
+
+// Cell of the world, the cells out of it are empty
+static inline char World_GetChar(const WorldText* text, int r, int c)
+{
+    if (r < 0 || c < 0 || r >= text->rowCount || c >= text->lengths[r])
+    {
+        return ' ';
+    }
+    return text->lines[r][c];
+}
+
+// What a character of the source creates: a tile, or an object
+static void World_ResolveCell(const WorldText* text, int wr, int wc, uint8_t* tile, WorldSpawn* spawn)
+{
+    // Position in the level
+    const int r = wr % text->levelRowCount;
+    const int c = wc % text->levelColumnCount;
+
+    const char s = World_GetChar(text, wr, wc);
+    const char st = World_GetChar(text, wr - 1, wc);
+    const char sb = World_GetChar(text, wr + 1, wc);
+
+    *tile = TYPE_NONE;
+    *spawn = (WorldSpawn){(uint8_t)r, (uint8_t)c, TYPE_NONE, 0};
+
+    // Wall and ground
+    if (s == '*' || s == 'x')
+    {
+        const ObjectTypeId type = s == '*' ? TYPE_WALL : TYPE_GROUND;
+        const ObjectTypeId type_top = s == '*' ? TYPE_WALL_TOP : TYPE_GROUND_TOP;
+        *tile = r == 0 || st == '*' || st == 'x' ? type : type_top;
+    // Water
+    }
+    else if (s == '~')
+    {
+        if (r == 0 || st == '~' || st == 'x' || st == '*') {
+            *tile = TYPE_WATER;
+        } else {
+            spawn->typeId = TYPE_WATER_TOP;
+        }
+    // Pillar
+    }
+    else if (s == '|')
+    {
+        if (r == 0 || st == '*' || st == 'x') {
+            *tile = TYPE_PILLAR_TOP;
+        } else if (r == text->levelRowCount - 1 || sb == '*' || sb == 'x') {
+            *tile = TYPE_PILLAR_BOTTOM;
+        } else {
+            *tile = TYPE_PILLAR;
+        }
+    // Spike
+    }
+    else if (s == '^')
+    {
+        *tile = st == '*' || st == 'x' ? TYPE_SPIKE_TOP : TYPE_SPIKE_BOTTOM;
+    // Other tiles
+    }
+    else if (s == '-')
+    {
+        *tile = TYPE_WALL_STAIR;
+    }
+    else if (s == ',')
+    {
+        *tile = (c + 1) % 3 ? TYPE_GRASS : TYPE_GRASS_BIG;
+    }
+    else if (s == '.')
+    {
+        *tile = TYPE_MUSHROOM1 + c % 3;
+    }
+    else if (s == ';')
+    {
+        *tile = c % 2 ? TYPE_TREE1 : TYPE_TREE2;
+    }
+    else if (s == '@')
+    {
+        *tile = TYPE_ROCK;
+    }
+    else if (s == '=')
+    {
+        *tile = TYPE_LADDER;
+    }
+    else if (s == 'd')
+    {
+        *tile = TYPE_DOOR;
+    }
+    else if (s == '<')
+    {
+        *tile = TYPE_ARROW_LEFT;
+    }
+    else if (s == '>')
+    {
+        *tile = TYPE_ARROW_RIGHT;
+    }
+    else if (s >= '1' && s <= '9')
+    {
+        spawn->typeId = TYPE_ACTION;
+        spawn->data = (uint8_t)s;
+    // Other objects
+    }
+    else
+    {
+        static const struct { char s; ObjectTypeId typeId; } objects[] = {
+            {'o', TYPE_COIN},       {'O', TYPE_GEM},        {'k', TYPE_KEY},
+            {'h', TYPE_HEART},      {'a', TYPE_APPLE},      {'i', TYPE_PEAR},
+            {'S', TYPE_STATUARY},   {'g', TYPE_GHOST},      {'s', TYPE_SCORPION},
+            {'p', TYPE_SPIDER},     {'r', TYPE_RAT},        {'b', TYPE_BAT},
+            {'q', TYPE_BLOB},       {'f', TYPE_FIREBALL},   {'e', TYPE_SKELETON},
+            {'`', TYPE_DROP},       {'_', TYPE_PLATFORM},   {'/', TYPE_SPRING},
+            {'&', TYPE_CLOUD1},     {'!', TYPE_TORCH}
+        };
+
+        for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); i++)
+        {
+            if (objects[i].s == s)
+            {
+                spawn->typeId = objects[i].typeId;
+                break;
+            }
+        }
+    }
+}
+
+// Reads "#level <columns> <rows>", returns false if the line is another comment
+static bool World_ParseLevelSize(const char* line, size_t length, int* rowCount, int* columnCount)
+{
+    char buffer[64];
+    char extra;
+
+    if (length >= sizeof(buffer))
+    {
+        return false;
+    }
+
+    memcpy(buffer, line, length);
+    buffer[length] = '\0';
+    return sscanf(buffer, "#level %d %d %c", columnCount, rowCount, &extra) == 2;
+}
+
+// Splits the text into the rows, skipping the comments and the empty lines
+// at the end
+static bool World_ParseText(WorldText* text, const char* source, size_t size)
+{
+    int reserved = 0;
+    int width = 0;
+    text->lines = NULL;
+    text->lengths = NULL;
+    text->rowCount = 0;
+    text->levelRowCount = SCREEN_ROW_COUNT;
+    text->levelColumnCount = SCREEN_COLUMN_COUNT;
+
+    for (size_t i = 0; i < size;)
+    {
+        size_t end = i;
+        while (end < size && source[end] != '\n')
+        {
+            end++;
+        }
+
+        size_t length = end - i;
+        if (length > 0 && source[i + length - 1] == '\r')
+        {
+            length--;
+        }
+
+        int levelRowCount, levelColumnCount;
+
+        if (length > 0 && source[i] == '#' && World_ParseLevelSize(source + i, length, &levelRowCount, &levelColumnCount))
+        {
+            if (text->rowCount > 0)
+            {
+                World_SetError("The level size must be given before the cells");
+                return false;
+            }
+
+            if (levelRowCount < LEVEL_SIZE_MIN || levelRowCount > LEVEL_SIZE_MAX
+                || levelColumnCount < LEVEL_SIZE_MIN || levelColumnCount > LEVEL_SIZE_MAX)
+            {
+                World_SetError("The level size must be %d..%d cells each way", LEVEL_SIZE_MIN, LEVEL_SIZE_MAX);
+                return false;
+            }
+
+            text->levelRowCount = levelRowCount;
+            text->levelColumnCount = levelColumnCount;
+        }
+        else if (length == 0 || source[i] != '#')
+        {
+            if (text->rowCount == reserved)
+            {
+                reserved = reserved ? reserved * 2 : 256;
+                text->lines = (const char**)realloc(text->lines, reserved * sizeof(const char*));
+                text->lengths = (int*)realloc(text->lengths, reserved * sizeof(int));
+                if (!text->lines || !text->lengths)
+                {
+                    World_SetError("Out of memory");
+                    return false;
+                }
+            }
+
+            text->lines[text->rowCount] = source + i;
+            text->lengths[text->rowCount] = (int)length;
+            text->rowCount += 1;
+            width = (int)length > width ? (int)length : width;
+        }
+
+        i = end + 1;
+    }
+
+    while (text->rowCount > 0 && text->lengths[text->rowCount - 1] == 0)
+    {
+        text->rowCount -= 1;
+    }
+
+    text->columnCount = (width + text->levelColumnCount - 1) / text->levelColumnCount * text->levelColumnCount;
+
+    if (text->rowCount == 0 || text->rowCount % text->levelRowCount != 0)
+    {
+        World_SetError("The world has %d rows, it must be a multiple of %d", text->rowCount, text->levelRowCount);
+        return false;
+    }
+    return true;
+}
+
+bool World_Compile(const char* source, size_t size, uint8_t** data, size_t* dataSize)
+{
+    WorldText text;
+    *data = NULL;
+
+    if (!World_ParseText(&text, source, size))
+    {
+        free(text.lines);
+        free(text.lengths);
+        return false;
+    }
+
+    const int levelRowCount = text.levelRowCount;
+    const int levelColumnCount = text.levelColumnCount;
+    const int cellCount = levelRowCount * levelColumnCount;
+    const int countX = text.columnCount / levelColumnCount;
+    const int countY = text.rowCount / levelRowCount;
+
+    // Start position
+    int startR = -1;
+    int startC = -1;
+    for (int r = 0; r < text.rowCount && startR < 0; r++)
+    {
+        const char* start = memchr(text.lines[r], 'P', text.lengths[r]);
+        if (start)
+        {
+            startR = r;
+            startC = (int)(start - text.lines[r]);
+        }
+    }
+
+    if (startR < 0)
+    {
+        World_SetError("The world has no start position 'P'");
+        free(text.lines);
+        free(text.lengths);
+        return false;
+    }
+
+    // The spawns take at most a cell each, so this is enough for any level
+    const size_t indexSize = (size_t)countX * countY * WORLD_INDEX_ENTRY_SIZE;
+    const size_t levelMaxSize = cellCount + cellCount * WORLD_SPAWN_SIZE;
+    size_t reserved = WORLD_HEADER_SIZE + indexSize + levelMaxSize;
+    uint8_t* bytes = (uint8_t*)malloc(reserved);
+    if (!bytes)
+    {
+        World_SetError("Out of memory");
+        free(text.lines);
+        free(text.lengths);
+        return false;
+    }
+
+    const uint32_t header[] = {WORLD_VERSION, TYPE_COUNT, levelRowCount, levelColumnCount,
+        countX, countY, startR, startC};
+    memcpy(bytes, WORLD_MAGIC, sizeof(WORLD_MAGIC));
+    for (size_t i = 0; i < sizeof(header) / sizeof(header[0]); i++)
+    {
+        World_WriteUint32(bytes + 4 + i * 4, header[i]);
+    }
+
+    size_t used = WORLD_HEADER_SIZE + indexSize;
+
+    for (int lr = 0; lr < countY && bytes; lr++)
+    {
+        for (int lc = 0; lc < countX && bytes; lc++)
+        {
+            if (used + levelMaxSize > reserved)
+            {
+                reserved = (used + levelMaxSize) * 2;
+                uint8_t* grown = (uint8_t*)realloc(bytes, reserved);
+                if (!grown)
+                {
+                    free(bytes);
+                    bytes = NULL;
+                    break;
+                }
+                bytes = grown;
+            }
+
+            if (used > UINT32_MAX)
+            {
+                World_SetError("The world is too large");
+                free(bytes);
+                bytes = NULL;
+                break;
+            }
+
+            uint8_t* tiles = bytes + used;
+            WorldSpawn* spawns = (WorldSpawn*)(tiles + cellCount);
+            uint32_t spawnCount = 0;
+
+            for (int r = 0; r < levelRowCount; r++)
+            {
+                for (int c = 0; c < levelColumnCount; c++)
+                {
+                    WorldSpawn spawn;
+                    World_ResolveCell(&text, lr * levelRowCount + r, lc * levelColumnCount + c,
+                        &tiles[r * levelColumnCount + c], &spawn);
+                    if (spawn.typeId != TYPE_NONE)
+                    {
+                        spawns[spawnCount] = spawn;
+                        spawnCount += 1;
+                    }
+                }
+            }
+
+            uint8_t* entry = bytes + WORLD_HEADER_SIZE + (size_t)(lr * countX + lc) * WORLD_INDEX_ENTRY_SIZE;
+            World_WriteUint32(entry, (uint32_t)used);
+            World_WriteUint32(entry + 4, spawnCount);
+            used += cellCount + spawnCount * WORLD_SPAWN_SIZE;
+        }
+    }
+
+    free(text.lines);
+    free(text.lengths);
+
+    if (!bytes)
+    {
+        if (!worldError[0])
+        {
+            World_SetError("Out of memory");
+        }
+        return false;
+    }
+
+    *data = bytes;
+    *dataSize = used;
+    return true;
+}
+
+// Loading
+
+// Checks everything the game relies on, so a damaged file can not crash it
+static bool World_Validate(World* world)
+{
+    const uint8_t* data = world->data;
+
+    if (world->size < WORLD_HEADER_SIZE || memcmp(data, WORLD_MAGIC, sizeof(WORLD_MAGIC)) != 0)
+    {
+        World_SetError("Not a compiled world");
+        return false;
+    }
+
+    if (World_ReadUint32(data + 4) != WORLD_VERSION)
+    {
+        World_SetError("Unsupported version %u", (unsigned)World_ReadUint32(data + 4));
+        return false;
+    }
+
+    if (World_ReadUint32(data + 8) != TYPE_COUNT)
+    {
+        World_SetError("The world was compiled for another version of the game");
+        return false;
+    }
+
+    const uint64_t rowCount = World_ReadUint32(data + 12);
+    const uint64_t columnCount = World_ReadUint32(data + 16);
+    const uint64_t countX = World_ReadUint32(data + 20);
+    const uint64_t countY = World_ReadUint32(data + 24);
+    const uint64_t startR = World_ReadUint32(data + 28);
+    const uint64_t startC = World_ReadUint32(data + 32);
+
+    if (rowCount < LEVEL_SIZE_MIN || rowCount > LEVEL_SIZE_MAX
+        || columnCount < LEVEL_SIZE_MIN || columnCount > LEVEL_SIZE_MAX
+        || countX == 0 || countY == 0 || countX * countY > INT32_MAX
+        || WORLD_HEADER_SIZE + countX * countY * WORLD_INDEX_ENTRY_SIZE > world->size
+        || startR >= countY * rowCount || startC >= countX * columnCount)
+    {
+        World_SetError("Damaged header");
+        return false;
+    }
+
+    const uint64_t cellCount = rowCount * columnCount;
+
+    for (uint64_t i = 0; i < countX * countY; i++)
+    {
+        const uint8_t* entry = data + WORLD_HEADER_SIZE + i * WORLD_INDEX_ENTRY_SIZE;
+        const uint64_t offset = World_ReadUint32(entry);
+        const uint64_t spawnCount = World_ReadUint32(entry + 4);
+
+        if (offset + cellCount + spawnCount * WORLD_SPAWN_SIZE > world->size)
+        {
+            World_SetError("Damaged index of level %d", (int)i);
+            return false;
+        }
+
+        for (uint64_t cell = 0; cell < cellCount; cell++)
+        {
+            if (data[offset + cell] >= TYPE_COUNT)
+            {
+                World_SetError("Damaged tiles of level %d", (int)i);
+                return false;
+            }
+        }
+
+        const WorldSpawn* spawns = (const WorldSpawn*)(data + offset + cellCount);
+        for (uint64_t s = 0; s < spawnCount; s++)
+        {
+            if (spawns[s].r >= rowCount || spawns[s].c >= columnCount || spawns[s].typeId >= TYPE_COUNT)
+            {
+                World_SetError("Damaged spawns of level %d", (int)i);
+                return false;
+            }
+        }
+    }
+
+    world->rowCount = (int)rowCount;
+    world->columnCount = (int)columnCount;
+    world->countX = (int)countX;
+    world->countY = (int)countY;
+    world->startR = (int)startR;
+    world->startC = (int)startC;
+    return true;
+}
+
+static uint8_t* World_ReadFile(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    uint8_t* data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0)
+    {
+        const long length = ftell(file);
+        if (length >= 0 && fseek(file, 0, SEEK_SET) == 0)
+        {
+            data = (uint8_t*)malloc(length > 0 ? length : 1);
+            if (data && fread(data, 1, length, file) != (size_t)length)
+            {
+                free(data);
+                data = NULL;
+            }
+            *size = (size_t)length;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+bool World_Open(World* world, const char* path)
+{
+    *world = (World){0};
+    worldError[0] = '\0';
+
+    char magic[sizeof(WORLD_MAGIC)] = {0};
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        World_SetError("Could not open %s", path);
+        return false;
+    }
+    const bool compiled = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+        && memcmp(magic, WORLD_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+
+#ifndef _WIN32
+    if (compiled)
+    {
+        const int fd = open(path, O_RDONLY);
+        struct stat status;
+        if (fd >= 0 && fstat(fd, &status) == 0 && status.st_size > 0)
+        {
+            void* data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                world->data = (const uint8_t*)data;
+                world->size = (size_t)status.st_size;
+                world->mapped = true;
+            }
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+#endif
+
+    if (!world->data)
+    {
+        size_t size = 0;
+        uint8_t* data = World_ReadFile(path, &size);
+        if (!data)
+        {
+            World_SetError("Could not read %s", path);
+            return false;
+        }
+
+        if (compiled)
+        {
+            world->data = data;
+            world->size = size;
+        }
+        else
+        {
+            uint8_t* compiledData = NULL;
+            size_t compiledSize = 0;
+            const bool ok = World_Compile((const char*)data, size, &compiledData, &compiledSize);
+            free(data);
+            if (!ok)
+            {
+                return false;
+            }
+            world->data = compiledData;
+            world->size = compiledSize;
+        }
+    }
+
+    if (!World_Validate(world))
+    {
+        World_Close(world);
+        return false;
+    }
+    return true;
+}
+
+void World_Close(World* world)
+{
+#ifndef _WIN32
+    if (world->mapped)
+    {
+        munmap((void*)world->data, world->size);
+    }
+    else
+#endif
+    {
+        free((void*)world->data);
+    }
+
+    *world = (World){0};
+}
+
+static inline const uint8_t* World_GetEntry(const World* world, int r, int c)
+{
+    return world->data + WORLD_HEADER_SIZE + (size_t)(r * world->countX + c) * WORLD_INDEX_ENTRY_SIZE;
+}
+
+const uint8_t* World_GetTiles(const World* world, int r, int c)
+{
+    return world->data + World_ReadUint32(World_GetEntry(world, r, c));
+}
+
+const WorldSpawn* World_GetSpawns(const World* world, int r, int c, int* count)
+{
+    const uint8_t* entry = World_GetEntry(world, r, c);
+    *count = (int)World_ReadUint32(entry + 4);
+    return (const WorldSpawn*)(world->data + World_ReadUint32(entry) + world->rowCount * world->columnCount);
+}
@@ -0,0 +1,106 @@
+/******************************************************************************
+ * Copyright (c) Artur Eganyan
+ *
+ * This software is provided "AS IS", WITHOUT ANY WARRANTY, express or implied.
+ ******************************************************************************/
+
+// Level compiler: turns a world source into a compiled world, see world.h
+
+#include "world.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static char* readFile(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    size_t reserved = 1 << 16;
+    char* data = (char*)malloc(reserved);
+    *size = 0;
+
+    while (data)
+    {
+        *size += fread(data + *size, 1, reserved - *size, file);
+        if (*size < reserved)
+        {
+            break;
+        }
+
+        reserved *= 2;
+        char* grown = (char*)realloc(data, reserved);
+        if (!grown)
+        {
+            free(data);
+        }
+        data = grown;
+    }
+
+    if (data && ferror(file))
+    {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(file);
+    return data;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s SOURCE OUTPUT\n", argv[0]);
+        printf("  Compiles the world SOURCE (e.g. levels/world.txt) to OUTPUT, for platformer --world\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t size = 0;
+    char* source = readFile(argv[1], &size);
+    if (!source)
+    {
+        printf("Could not read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t* data = NULL;
+    size_t dataSize = 0;
+    const bool compiled = World_Compile(source, size, &data, &dataSize);
+    free(source);
+
+    if (!compiled)
+    {
+        printf("%s: %s\n", argv[1], World_GetError());
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(argv[2], "wb");
+    const bool written = file && fwrite(data, 1, dataSize, file) == dataSize;
+    if (file && fclose(file) != 0)
+    {
+        file = NULL;
+    }
+    free(data);
+
+    if (!written || !file)
+    {
+        printf("Could not write %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    // Check the result the way the game loads it
+    World world;
+    if (!World_Open(&world, argv[2]))
+    {
+        printf("%s: %s\n", argv[2], World_GetError());
+        return EXIT_FAILURE;
+    }
+
+    printf("%s: %d x %d levels of %d x %d cells, %zu bytes\n", argv[2], world.countX, world.countY,
+        world.columnCount, world.rowCount, dataSize);
+    World_Close(&world);
+    return EXIT_SUCCESS;
+}